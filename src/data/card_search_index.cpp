@@ -0,0 +1,182 @@
+//+----------------------------------------------------------------------------+
+//| Description:  Magic Set Editor - Program to make Magic (tm) cards          |
+//| Copyright:    (C) Twan van Laarhoven and the other MSE developers          |
+//| License:      GNU General Public License 2 or later (see file COPYING)     |
+//+----------------------------------------------------------------------------+
+
+// ----------------------------------------------------------------------------- : Includes
+
+#include <util/prec.hpp>
+#include <data/card_search_index.hpp>
+#include <data/set.hpp>
+#include <data/game.hpp>
+#include <data/card.hpp>
+#include <data/field/text.hpp>
+#include <data/action/set.hpp>
+#include <data/action/value.hpp>
+
+/// Minimal number of dirty cards before the index is rebuilt
+const size_t MIN_DIRTY_CARDS_FOR_REBUILD = 256;
+
+// ----------------------------------------------------------------------------- : Trigrams
+
+/// The distinct trigrams of a string, lower case, sorted
+void trigrams_of(const String& text, vector<unsigned long long>& out) {
+  out.clear();
+  unsigned long long trigram = 0;
+  size_t length = 0;
+  for (wxUniChar c : text) {
+    // 21 bits are enough for any unicode character
+    trigram = ((trigram << 21) | (toLower(c) & 0x1FFFFF)) & 0x7FFFFFFFFFFFFFFFull;
+    if (++length >= 3) out.push_back(trigram);
+  }
+  sort(out.begin(), out.end());
+  out.erase(unique(out.begin(), out.end()), out.end());
+}
+
+// ----------------------------------------------------------------------------- : CardSearchIndex
+
+CardSearchIndex::CardSearchIndex(Set& set)
+  : set(set), built(false), dirty_count(0), notes_field(0)
+{
+  set.actions.addListener(this);
+}
+
+CardSearchIndex::~CardSearchIndex() {
+  set.actions.removeListener(this);
+}
+
+void CardSearchIndex::update() {
+  if (!built || dirty_count > max(MIN_DIRTY_CARDS_FOR_REBUILD, card_ids.size() / 4)) {
+    rebuild();
+  }
+}
+
+void CardSearchIndex::rebuild() {
+  postings.clear();
+  card_ids.clear();
+  dirty.assign(set.cards.size(), false);
+  dirty_count = 0;
+  field_names.clear();
+  FOR_EACH(f, set.game->card_fields) {
+    field_names.push_back(f->name);
+  }
+  notes_field = (UInt)field_names.size();
+  field_names.push_back(_("notes"));
+  UInt id = 0;
+  FOR_EACH(card, set.cards) {
+    card_ids[card.get()] = id;
+    add(*card, id);
+    ++id;
+  }
+  built = true;
+}
+
+void CardSearchIndex::add(const Card& card, UInt id) {
+  UInt field = 0;
+  FOR_EACH_CONST(v, card.data) {
+    if (field >= notes_field) break; // card of a different game?
+    add(v->toString(), id, field++);
+  }
+  add(card.notes, id, notes_field);
+}
+
+void CardSearchIndex::add(const String& text, UInt card, UInt field) {
+  vector<Trigram> trigrams;
+  trigrams_of(text, trigrams);
+  FOR_EACH(t, trigrams) {
+    postings[t].push_back(Posting{card, field});
+  }
+}
+
+void CardSearchIndex::markDirty(const Card* card) {
+  auto it = card_ids.find(card);
+  if (it != card_ids.end() && !dirty[it->second]) {
+    dirty[it->second] = true;
+    ++dirty_count;
+  }
+}
+
+void CardSearchIndex::onAction(const Action& action, bool undone) {
+  if (!built) return; // nothing to keep up to date
+  TYPE_CASE(action, ValueAction) {
+    if (action.card) {
+      markDirty(action.card.get());
+    } else if (FakeTextValue* value = dynamic_cast<FakeTextValue*>(action.valueP.get())) {
+      // the notes of a card are edited as a fake value
+      FOR_EACH(card, set.cards) {
+        if (&card->notes == value->underlying) markDirty(card.get());
+      }
+    }
+    return;
+  }
+  TYPE_CASE(action, ScriptValueEvent) {
+    markDirty(action.card);
+    return;
+  }
+  TYPE_CASE(action, ReplaceAllAction) {
+    FOR_EACH_CONST(a, action.actions) {
+      if (a.card) markDirty(a.card.get());
+    }
+    return;
+  }
+  TYPE_CASE(action, AddCardAction) {
+    // added cards are not in the index, removed cards should be forgotten,
+    // because their memory can be reused by new cards
+    FOR_EACH_CONST(s, action.action.steps) {
+      card_ids.erase(s.item.get());
+      ++dirty_count;
+    }
+    return;
+  }
+}
+
+void CardSearchIndex::getItems(const vector<QuickFilterPart>& query, const vector<CardP>& in, vector<VoidP>& out) {
+  update();
+  // for each card: how many of the trigrams of the query it contains, only counting fields of the right type
+  vector<UInt> counts(dirty.size(), 0);
+  UInt needed = 0;
+  bool none = false; // no card in the index can match
+  vector<Trigram> trigrams;
+  vector<bool> field_ok(field_names.size());
+  FOR_EACH_CONST(part, query) {
+    if (!part.need_match) continue;
+    trigrams_of(part.query, trigrams);
+    if (trigrams.empty()) continue;
+    for (size_t i = 0 ; i < field_names.size() ; ++i) {
+      field_ok[i] = part.type.empty() || find_i(field_names[i], part.type) != String::npos;
+    }
+    FOR_EACH(t, trigrams) {
+      auto it = postings.find(t);
+      if (it == postings.end()) {
+        none = true;
+        break;
+      }
+      FOR_EACH_CONST(p, it->second) {
+        // a card is only counted once per trigram, and only if it contained all previous ones
+        if (field_ok[p.field] && counts[p.card] == needed) ++counts[p.card];
+      }
+      ++needed;
+    }
+    if (none) break;
+  }
+  // check the candidates
+  FOR_EACH_CONST(card, in) {
+    auto it = card_ids.find(card.get());
+    bool candidate = it == card_ids.end() || dirty[it->second] || (!none && counts[it->second] == needed);
+    if (candidate && match_quicksearch_query(query, *card)) {
+      out.push_back(card);
+    }
+  }
+}
+
+// ----------------------------------------------------------------------------- : IndexedCardFilter
+
+IndexedCardFilter::IndexedCardFilter(const SetP& set, const String& query)
+  : QuickFilter<Card>(query)
+  , set(set)
+{}
+
+void IndexedCardFilter::getItems(const vector<CardP>& in, vector<VoidP>& out) const {
+  set->searchIndex().getItems(query, in, out);
+}
@@ -0,0 +1,73 @@
+//+----------------------------------------------------------------------------+
+//| Description:  Magic Set Editor - Program to make Magic (tm) cards          |
+//| Copyright:    (C) Twan van Laarhoven and the other MSE developers          |
+//| License:      GNU General Public License 2 or later (see file COPYING)     |
+//+----------------------------------------------------------------------------+
+
+#pragma once
+
+// ----------------------------------------------------------------------------- : Includes
+
+#include <util/prec.hpp>
+#include <util/action_stack.hpp>
+#include <data/filter.hpp>
+
+class Set;
+DECLARE_POINTER_TYPE(Set);
+DECLARE_POINTER_TYPE(Card);
+
+// ----------------------------------------------------------------------------- : CardSearchIndex
+
+/// An index of the trigrams in the field values and notes of the cards in a set, for quick searching
+/** For each trigram (three lower case characters) the index knows the card fields that contain it.
+ *  A card can only contain a query if it contains all trigrams of that query,
+ *  so only cards with all of them have to be checked with Card::contains.
+ *
+ *  Cards that are changed are remembered as 'dirty', these are always checked.
+ *  When too many cards are dirty the index is rebuilt, this also happens the first time it is used.
+ *  Should only be used from the main thread.
+ */
+class CardSearchIndex : public ActionListener {
+public:
+  CardSearchIndex(Set& set);
+  ~CardSearchIndex();
+
+  /// Select the cards that match a quick search query, in the same order as the input
+  void getItems(const vector<QuickFilterPart>& query, const vector<CardP>& in, vector<VoidP>& out);
+
+  void onAction(const Action& action, bool undone) override;
+
+private:
+  typedef unsigned long long Trigram;
+  struct Posting {
+    UInt card;  ///< Id of the card
+    UInt field; ///< Index of the field in Card::data, or notes_field
+  };
+
+  Set& set;
+  bool built;
+  unordered_map<Trigram,vector<Posting>> postings;
+  unordered_map<const Card*,UInt> card_ids; ///< Cards in the index, not containing removed cards
+  vector<bool> dirty;                       ///< Has the card with the given id changed since the index was built?
+  size_t dirty_count;                       ///< Number of dirty, added and removed cards
+  vector<String> field_names;               ///< Names of the fields by index, the last one is "notes"
+  UInt notes_field;
+
+  /// Rebuild the index if it is not built yet, or if too many cards are dirty
+  void update();
+  void rebuild();
+  void add(const Card& card, UInt id);
+  void add(const String& text, UInt card, UInt field);
+  void markDirty(const Card* card);
+};
+
+// ----------------------------------------------------------------------------- : IndexedCardFilter
+
+/// A quick search filter for the cards of a set, that uses the CardSearchIndex of the set
+class IndexedCardFilter : public QuickFilter<Card> {
+public:
+  IndexedCardFilter(const SetP& set, const String& query);
+  void getItems(const vector<CardP>& in, vector<VoidP>& out) const override;
+private:
+  SetP set;
+};
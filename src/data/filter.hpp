@@ -67,7 +67,7 @@ public:
   bool keep(T const& x) const override {
     return match_quicksearch_query(query, x);
   }
-private:
+protected:
   vector<QuickFilterPart> query;
 };
 
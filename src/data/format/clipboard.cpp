@@ -27,6 +27,7 @@ String serialize_for_clipboard(Package& package, T& object) {
   Writer writer(stream, file_version_clipboard);
   WITH_DYNAMIC_ARG(clipboard_package, &package);
     writer.handle(object);
+  writer.flush();
   return stream.GetString();
 }
 
@@ -13,6 +13,7 @@
 #include <data/settings.hpp>
 
 class Game;
+class StyleSheet;
 DECLARE_POINTER_TYPE(Set);
 DECLARE_POINTER_TYPE(Card);
 
@@ -92,16 +93,46 @@ FileFormatP mtg_editor_file_format();
 void export_images(Window* parent, const SetP& set);
 
 /// Export the image for each card in a list of cards
+/** If parallel, the images are rendered on the main thread,
+ *  but scaled, compressed and written to disk by a pool of worker threads, one per core.
+ */
 void export_images(const SetP& set, const vector<CardP>& cards,
                    const String& path, const String& filename_template, FilenameConflicts conflicts,
-                   int quality = 100, int out_width = -1, int out_height = -1);
+                   int quality = 100, int out_width = -1, int out_height = -1, bool parallel = true);
 
 /// Export the image of a single card
 void export_image(const SetP& set, const CardP& card, const String& filename,
                   int quality = 100, int out_width = -1, int out_height = -1);
 
+/// The parts of render cache keys that are the same for the cards of an export
+/** Computing them means serializing the set and checking all packages it depends on,
+ *  so they are remembered for each stylesheet, and only the card is hashed for each card.
+ *  Should only be used for a single export, because changes to the set are not noticed.
+ */
+class RenderCacheKeys {
+public:
+  RenderCacheKeys(const SetP& set) : set(set) {}
+  /// Hash of everything that influences the rendering of cards with the given stylesheet, except for the cards themselves
+  unsigned long long sharedHash(const StyleSheet& stylesheet, bool use_zoom_settings);
+private:
+  SetP set;
+  map<pair<const StyleSheet*,bool>, unsigned long long> shared_hashes;
+};
+
 /// Generate a bitmap image of a card
-Bitmap export_bitmap(const SetP& set, const CardP& card);
+/** If the render cache is used, keys can be given to share the work of computing the keys between cards */
+Bitmap export_bitmap(const SetP& set, const CardP& card, RenderCacheKeys* keys = nullptr);
+
+/// Resize an image generated by export_bitmap and save it to a file
+/** Does not use the set or its scripts, so this can be called from any thread */
+void save_exported_image(Image& img, const String& filename, int quality, int out_width, int out_height);
+
+/// Export card images for all jobs in a manifest file, in a single run
+/** Each set is only loaded once, even if it is used by multiple jobs.
+ *  A report with the time taken for each card is written to report_filename, or to the cli if it is empty.
+ *  Returns false if any of the jobs failed.
+ */
+bool export_image_batch(const String& manifest_filename, const String& report_filename);
 
 /// Export a set to Magic Workstation format
 void export_mws(Window* parent, const SetP& set);
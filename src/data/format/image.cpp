@@ -13,14 +13,21 @@
 #include <data/card.hpp>
 #include <data/stylesheet.hpp>
 #include <data/settings.hpp>
+#include <data/game.hpp>
+#include <data/field/image.hpp>
+#include <data/field/symbol.hpp>
+#include <util/io/package_manager.hpp>
 #include <render/card/viewer.hpp>
 #include <wx/filename.h>
+#include <wx/dir.h>
+#include <wx/thread.h>
+#include <wx/sstream.h>
+#include <queue>
 #include <gfx/gfx.hpp>
 
 // ----------------------------------------------------------------------------- : Single card export
 
-void export_image(const SetP& set, const CardP& card, const String& filename, int quality, int out_width, int out_height) {
-  Image in = export_bitmap(set, card).ConvertToImage();
+void save_exported_image(Image& in, const String& filename, int quality, int out_width, int out_height) {
   in.SetOption(wxIMAGE_OPTION_QUALITY, quality);
   Image out;
   if (out_width > 0 && out_height > 0) {
@@ -38,6 +45,11 @@ void export_image(const SetP& set, const CardP& card, const String& filename, in
   out.Destroy();
 }
 
+void export_image(const SetP& set, const CardP& card, const String& filename, int quality, int out_width, int out_height) {
+  Image in = export_bitmap(set, card).ConvertToImage();
+  save_exported_image(in, filename, quality, out_width, out_height);
+}
+
 class UnzoomedDataViewer : public DataViewer {
 public:
   UnzoomedDataViewer(bool use_zoom_settings)
@@ -58,14 +70,177 @@ Rotation UnzoomedDataViewer::getRotation() const {
   }
 }
 
-Bitmap export_bitmap(const SetP& set, const CardP& card) {
+// ----------------------------------------------------------------------------- : Render cache
+
+String image_cache_dir();
+
+/// Rendered cards that are not used for this many days are removed from the cache
+const int RENDER_CACHE_MAX_AGE_DAYS = 30;
+/// Maximum size of the render cache, when it is larger the least recently used cards are removed
+const wxULongLong RENDER_CACHE_MAX_SIZE = 256 * 1024 * 1024;
+
+/// Remove old files from the render cache, and the least recently used ones if it is too large
+void prune_render_cache(const String& dir) {
+  wxArrayString files;
+  wxDir::GetAllFiles(dir, &files, _("*.png"), wxDIR_FILES);
+  vector<pair<wxDateTime,pair<wxULongLong,String>>> entries; // by last use
+  wxDateTime too_old = wxDateTime::Now() - wxDateSpan::Days(RENDER_CACHE_MAX_AGE_DAYS);
+  wxULongLong total = 0;
+  FOR_EACH(f, files) {
+    wxFileName fn(f);
+    wxDateTime used = fn.GetModificationTime();
+    if (!used.IsValid() || used < too_old) {
+      wxRemoveFile(f);
+    } else {
+      wxULongLong size = fn.GetSize();
+      if (size == wxInvalidSize) size = 0;
+      total += size;
+      entries.push_back(make_pair(used, make_pair(size, f)));
+    }
+  }
+  if (total <= RENDER_CACHE_MAX_SIZE) return;
+  sort(entries.begin(), entries.end());
+  FOR_EACH(e, entries) {
+    if (total <= RENDER_CACHE_MAX_SIZE) break;
+    wxRemoveFile(e.second.second);
+    total -= e.second.first;
+  }
+}
+
+/// Directory in which rendered cards are cached
+/** The first time it is used in a run of the program the cache is pruned */
+String render_cache_dir() {
+  static bool pruned = false;
+  String dir = image_cache_dir() + _("render");
+  if (!wxDirExists(dir)) wxMkdir(dir);
+  if (!pruned) {
+    pruned = true;
+    prune_render_cache(dir);
+  }
+  return dir + _("/");
+}
+
+/// Add the stamps of the image and symbol files used by the values to the key data
+void add_file_stamps(String& data, Package& package, const IndexMap<FieldP,ValueP>& values) {
+  FOR_EACH_CONST(v, values) {
+    String file;
+    if (ImageValue* image = dynamic_cast<ImageValue*>(v.get())) {
+      file = image->filename.toStringForKey();
+    } else if (SymbolValue* symbol = dynamic_cast<SymbolValue*>(v.get())) {
+      file = symbol->filename.toStringForKey();
+    }
+    if (!file.empty()) data << _("\n") << file << _(" ") << package.fileStamp(file);
+  }
+}
+
+/// Add the names, versions and modification times of the dependencies of a package to the key data
+void add_dependency_stamps(String& data, const Packaged& package, std::set<String>& done) {
+  FOR_EACH_CONST(dep, package.dependencies) {
+    if (!done.insert(dep->package).second) continue;
+    data << _("\n") << dep->package;
+    try {
+      PackagedP p = package_manager.openAny(dep->package, true);
+      data << _(" ") << p->version.toString() << _(" ") << p->lastModified().GetTicks();
+      add_dependency_stamps(data, *p, done);
+    } catch (const Error&) {
+      data << _(" missing");
+    }
+  }
+}
+
+/// Continue a 64 bit FNV-1a hash with the given data
+void hash_data(unsigned long long& hash, const String& data) {
+  wxScopedCharBuffer utf8 = data.utf8_str();
+  for (size_t i = 0 ; i < utf8.length() ; ++i) {
+    hash = (hash ^ (unsigned char)utf8[i]) * 1099511628211ULL;
+  }
+}
+
+unsigned long long RenderCacheKeys::sharedHash(const StyleSheet& stylesheet, bool use_zoom_settings) {
+  auto it = shared_hashes.find(make_pair(&stylesheet, use_zoom_settings));
+  if (it != shared_hashes.end()) return it->second;
+  IndexMap<FieldP,ValueP>& styling = set->stylingDataFor(stylesheet);
+  wxStringOutputStream stream;
+  {
+    Writer writer(stream, app_version);
+    writer.handle(_("set_info"), set->data);
+    writer.handle(_("styling"), styling);
+  }
+  String data = set->absoluteFilename() + _("\n") + stream.GetString();
+  add_file_stamps(data, *set, set->data);
+  add_file_stamps(data, *set, styling);
+  data << _("\n") << set->game->name() << _(" ") << set->game->version.toString()
+       << _(" ") << set->game->lastModified().GetTicks();
+  data << _("\n") << stylesheet.name() << _(" ") << stylesheet.version.toString()
+       << _(" ") << stylesheet.lastModified().GetTicks();
+  std::set<String> done;
+  add_dependency_stamps(data, *set->game, done);
+  add_dependency_stamps(data, stylesheet, done);
+  if (use_zoom_settings) {
+    const StyleSheetSettings& ss = settings.stylesheetSettingsFor(stylesheet);
+    data << _("\n") << ss.card_zoom() << _(" ") << ss.card_angle();
+  }
+  unsigned long long hash = 14695981039346656037ULL;
+  hash_data(hash, data);
+  shared_hashes[make_pair(&stylesheet, use_zoom_settings)] = hash;
+  return hash;
+}
+
+/// Key under which a rendered card is stored in the render cache
+/** The key is a hash of everything that can influence the rendering of the card:
+ *   - the filename of the set
+ *   - the card, including its values, styling data and stylesheet
+ *   - the values and styling data of the set
+ *   - the contents of the image and symbol files used by these values, by their Package::fileStamp
+ *   - the game and stylesheet packages and the packages they depend on: their name, version and modification time
+ *   - the size and rotation of the output
+ *  So if any of these change we simply get a different key, there is no need to invalidate.
+ *
+ *  Everything except the card is hashed by keys.sharedHash, once per stylesheet for an export,
+ *  the hash of the card continues from that.
+ */
+String render_cache_key(RenderCacheKeys& keys, const SetP& set, const CardP& card, const RealSize& size, bool use_zoom_settings) {
+  unsigned long long hash = keys.sharedHash(set->stylesheetFor(card), use_zoom_settings);
+  wxStringOutputStream stream;
+  {
+    Writer writer(stream, app_version);
+    writer.handle(_("card"), card);
+  }
+  String data = stream.GetString();
+  add_file_stamps(data, *set, card->data);
+  if (card->has_styling) add_file_stamps(data, *set, card->styling_data);
+  hash_data(hash, data);
+  return wxString::Format(_("%016llx-%dx%d"), hash, (int)size.width, (int)size.height);
+}
+
+// ----------------------------------------------------------------------------- : Bitmap export
+
+Bitmap export_bitmap(const SetP& set, const CardP& card, RenderCacheKeys* keys) {
   if (!set) throw Error(_("no set"));
   // create viewer
-  UnzoomedDataViewer viewer(!settings.stylesheetSettingsFor(set->stylesheetFor(card)).card_normal_export());
+  bool use_zoom_settings = !settings.stylesheetSettingsFor(set->stylesheetFor(card)).card_normal_export();
+  UnzoomedDataViewer viewer(use_zoom_settings);
   viewer.setSet(set);
   viewer.setCard(card);
   // size of cards
   RealSize size = viewer.getRotation().getExternalSize();
+  // was this card rendered before?
+  String cache_file;
+  if (settings.render_cache) {
+    unique_ptr<RenderCacheKeys> own_keys;
+    if (!keys) {
+      own_keys = make_unique<RenderCacheKeys>(set);
+      keys = own_keys.get();
+    }
+    cache_file = render_cache_dir() + render_cache_key(*keys, set, card, size, use_zoom_settings) + _(".png");
+    if (wxFileExists(cache_file)) {
+      Image img;
+      if (img.LoadFile(cache_file, wxBITMAP_TYPE_PNG) && img.GetWidth() == (int)size.width && img.GetHeight() == (int)size.height) {
+        wxFileName(cache_file).Touch(); // recently used, see prune_render_cache
+        return Bitmap(img);
+      }
+    }
+  }
   // create bitmap & dc
   Bitmap bitmap((int) size.width, (int) size.height);
   if (!bitmap.Ok()) throw InternalError(_("Unable to create bitmap"));
@@ -74,15 +249,149 @@ Bitmap export_bitmap(const SetP& set, const CardP& card) {
   // draw
   viewer.draw(dc);
   dc.SelectObject(wxNullBitmap);
+  // store in cache
+  if (!cache_file.empty()) {
+    bitmap.ConvertToImage().SaveFile(cache_file, wxBITMAP_TYPE_PNG);
+  }
   return bitmap;
 }
 
+// ----------------------------------------------------------------------------- : Parallel image writing
+
+class ImageExportWorker;
+
+/// A pool of threads that resample, encode and write exported card images
+/** Drawing a card uses a wxMemoryDC, which may only be used from the main thread.
+ *  The style scripts of a card could be evaluated on other threads with their own SetScriptContext,
+ *  but they store their results in the Style objects of the stylesheet, which are shared by all cards.
+ *  So cards are still styled and rendered one at a time by the main thread, but everything after that
+ *  (resampling, PNG/JPEG compression and disk IO) happens in parallel on the worker threads.
+ *  Because the same save_exported_image function is used, the output is identical to a serial export.
+ */
+class ImageExportPool {
+public:
+  ImageExportPool(int thread_count, int quality, int out_width, int out_height);
+  ~ImageExportPool();
+  
+  /// Add an image to be written, blocks if too many images are waiting already
+  void add(Image& img, const String& filename);
+  /// Wait until all images are written. Throws an error if any of the workers failed.
+  void finish();
+  
+private:
+  wxMutex     mutex;
+  wxCondition changed;   ///< Signaled when a job is added or completed
+  
+  struct Job {
+    Image  image;
+    String filename;
+  };
+  deque<Job>                 jobs;     ///< Images waiting to be written
+  vector<ImageExportWorker*> workers;
+  size_t                     max_pending; ///< Maximum size of jobs, to limit memory usage
+  bool                       done = false; ///< No more jobs will be added
+  String                     error;   ///< First error message from a worker, if any
+  const int quality, out_width, out_height;
+  
+  friend class ImageExportWorker;
+  /// Take the next job from the queue, returns false when there are no more jobs
+  bool next(Job& job);
+  void stopWorkers();
+};
+
+class ImageExportWorker : public wxThread {
+public:
+  ImageExportWorker(ImageExportPool& pool)
+    : wxThread(wxTHREAD_JOINABLE), pool(pool)
+  {}
+  ExitCode Entry() override;
+private:
+  ImageExportPool& pool;
+};
+
+wxThread::ExitCode ImageExportWorker::Entry() {
+  ImageExportPool::Job job;
+  while (pool.next(job)) {
+    try {
+      save_exported_image(job.image, job.filename, pool.quality, pool.out_width, pool.out_height);
+    } catch (const Error& e) {
+      wxMutexLocker lock(pool.mutex);
+      if (pool.error.empty()) pool.error = e.what();
+    }
+    job.image.Destroy();
+  }
+  return 0;
+}
+
+ImageExportPool::ImageExportPool(int thread_count, int quality, int out_width, int out_height)
+  : changed(mutex)
+  , max_pending(2 * thread_count)
+  , quality(quality), out_width(out_width), out_height(out_height)
+{
+  for (int i = 0 ; i < thread_count ; ++i) {
+    ImageExportWorker* worker = new ImageExportWorker(*this);
+    if (worker->Create() != wxTHREAD_NO_ERROR || worker->Run() != wxTHREAD_NO_ERROR) {
+      delete worker;
+      break;
+    }
+    workers.push_back(worker);
+  }
+}
+
+ImageExportPool::~ImageExportPool() {
+  stopWorkers();
+}
+
+void ImageExportPool::add(Image& img, const String& filename) {
+  if (workers.empty()) {
+    // no threads could be started, write the image ourselves
+    save_exported_image(img, filename, quality, out_width, out_height);
+    return;
+  }
+  wxMutexLocker lock(mutex);
+  while (jobs.size() >= max_pending) changed.Wait();
+  jobs.push_back(Job());
+  // wxImage data is reference counted without locking, so hand over the only reference
+  jobs.back().image    = img;
+  jobs.back().filename = filename;
+  img.Destroy();
+  changed.Broadcast();
+}
+
+bool ImageExportPool::next(Job& job) {
+  wxMutexLocker lock(mutex);
+  while (jobs.empty() && !done) changed.Wait();
+  if (jobs.empty()) return false;
+  job = jobs.front();
+  jobs.pop_front();
+  changed.Broadcast();
+  return true;
+}
+
+void ImageExportPool::stopWorkers() {
+  {
+    wxMutexLocker lock(mutex);
+    done = true;
+    changed.Broadcast();
+  }
+  FOR_EACH(worker, workers) {
+    worker->Wait();
+    delete worker;
+  }
+  workers.clear();
+}
+
+void ImageExportPool::finish() {
+  stopWorkers();
+  if (!error.empty()) throw Error(error);
+}
+
 // ----------------------------------------------------------------------------- : Multiple card export
 
 
 void export_images(const SetP& set, const vector<CardP>& cards,
                    const String& path, const String& filename_template, FilenameConflicts conflicts,
-                   int quality, int out_width, int out_height)
+                   int quality, int out_width, int out_height, bool parallel)
 {
   wxBusyCursor busy;
   // Script
@@ -91,6 +400,13 @@ void export_images(const SetP& set, const vector<CardP>& cards,
   wxFileName fn(path);
   // Export
   std::set<String> used; // for CONFLICT_NUMBER_OVERWRITE
+  // Worker threads for writing
+  unique_ptr<ImageExportPool> pool;
+  RenderCacheKeys keys(set);
+  int thread_count = wxThread::GetCPUCount();
+  if (parallel && cards.size() > 1 && thread_count > 1) {
+    pool = make_unique<ImageExportPool>(thread_count, quality, out_width, out_height);
+  }
   FOR_EACH_CONST(card, cards) {
     // filename for this card
     Context& ctx = set->getContext(card);
@@ -103,6 +419,13 @@ void export_images(const SetP& set, const vector<CardP>& cards,
     // write image
     filename = fn.GetFullPath();
     used.insert(filename);
-    export_image(set, card, filename, quality, out_width, out_height);
+    if (pool) {
+      Image img = export_bitmap(set, card, &keys).ConvertToImage();
+      pool->add(img, filename);
+    } else {
+      Image img = export_bitmap(set, card, &keys).ConvertToImage();
+      save_exported_image(img, filename, quality, out_width, out_height);
+    }
   }
+  if (pool) pool->finish();
 }
@@ -0,0 +1,224 @@
+//+----------------------------------------------------------------------------+
+//| Description:  Magic Set Editor - Program to make Magic (tm) cards          |
+//| Copyright:    (C) Twan van Laarhoven and the other MSE developers          |
+//| License:      GNU General Public License 2 or later (see file COPYING)     |
+//+----------------------------------------------------------------------------+
+
+// ----------------------------------------------------------------------------- : Includes
+
+#include <util/prec.hpp>
+#include <util/tagged_string.hpp>
+#include <util/file_utils.hpp>
+#include <data/format/formats.hpp>
+#include <data/set.hpp>
+#include <data/card.hpp>
+#include <script/script.hpp>
+#include <script/context.hpp>
+#include <script/parser.hpp>
+#include <cli/text_io_handler.hpp>
+#include <wx/filename.h>
+#include <wx/wfstream.h>
+#include <wx/sstream.h>
+#include <wx/stopwatch.h>
+
+// ----------------------------------------------------------------------------- : Manifest
+
+/// A single entry in an export batch manifest: export (some of) the cards of a set
+class ExportBatchJob {
+public:
+  ExportBatchJob();
+
+  String            set;        ///< Filename of the set
+  String            filename;   ///< Filename template for the images, as for --export
+  int               quality;    ///< Image quality [0-100]
+  int               width;      ///< Width of the images, or <= 0 for the card size
+  int               height;     ///< Height of the images, or <= 0 for the card size
+  FilenameConflicts conflicts;  ///< How to handle existing files
+  vector<String>    cards;      ///< Identification of the cards to export, all cards if empty
+
+  DECLARE_REFLECTION();
+};
+
+ExportBatchJob::ExportBatchJob()
+  : quality(100)
+  , width(-1), height(-1)
+  , conflicts(CONFLICT_NUMBER_OVERWRITE)
+{}
+
+IMPLEMENT_REFLECTION_NO_SCRIPT(ExportBatchJob) {
+  REFLECT(set);
+  REFLECT(filename);
+  REFLECT(quality);
+  REFLECT(width);
+  REFLECT(height);
+  REFLECT(conflicts);
+  REFLECT(cards);
+}
+
+/// A list of export jobs, read from a manifest file
+class ExportBatch {
+public:
+  vector<ExportBatchJob> jobs;
+
+  DECLARE_REFLECTION();
+};
+
+IMPLEMENT_REFLECTION_NO_SCRIPT(ExportBatch) {
+  REFLECT(jobs);
+}
+
+// ----------------------------------------------------------------------------- : Report
+
+/// Timing of the export of a single card, in milliseconds
+class ExportBatchCardReport {
+public:
+  String card;
+  String file;
+  int    render_time = 0;
+  int    write_time  = 0;
+
+  DECLARE_REFLECTION();
+};
+
+IMPLEMENT_REFLECTION_NO_SCRIPT(ExportBatchCardReport) {
+  REFLECT(card);
+  REFLECT(file);
+  REFLECT(render_time);
+  REFLECT(write_time);
+}
+
+/// Result of a single job
+class ExportBatchJobReport {
+public:
+  String set;
+  int    load_time = 0; ///< Time to open the set, 0 if it was already opened by a previous job
+  int    total_time = 0;
+  String error;
+  vector<ExportBatchCardReport> cards;
+
+  DECLARE_REFLECTION();
+};
+
+IMPLEMENT_REFLECTION_NO_SCRIPT(ExportBatchJobReport) {
+  REFLECT(set);
+  REFLECT(load_time);
+  REFLECT(total_time);
+  if (!error.empty()) REFLECT(error);
+  REFLECT(cards);
+}
+
+class ExportBatchReport {
+public:
+  int total_time = 0;
+  int errors     = 0;
+  vector<ExportBatchJobReport> jobs;
+
+  DECLARE_REFLECTION();
+};
+
+IMPLEMENT_REFLECTION_NO_SCRIPT(ExportBatchReport) {
+  REFLECT(total_time);
+  REFLECT(errors);
+  REFLECT(jobs);
+}
+
+// ----------------------------------------------------------------------------- : Running a batch
+
+/// Make a path from the manifest absolute, relative to the directory of the manifest
+String batch_path(const String& path, const String& manifest_dir) {
+  wxFileName fn(path);
+  fn.MakeAbsolute(manifest_dir);
+  return fn.GetFullPath();
+}
+
+void export_job(const ExportBatchJob& job, const SetP& set, ExportBatchJobReport& report, const String& manifest_dir) {
+  // Path
+  String out = batch_path(job.filename.empty() ? settings.gameSettingsFor(*set->game).images_export_filename : job.filename, manifest_dir);
+  wxFileName fn(out);
+  if (!wxDirExists(fn.GetPath())) wxFileName::Mkdir(fn.GetPath(), wxS_DIR_DEFAULT, wxPATH_MKDIR_FULL);
+  // Script
+  ScriptP filename_script = parse(fn.GetFullName(), nullptr, true);
+  // Export
+  std::set<String> used; // for CONFLICT_NUMBER_OVERWRITE
+  RenderCacheKeys keys(set);
+  FOR_EACH_CONST(card, set->cards) {
+    if (!job.cards.empty() && find(job.cards.begin(), job.cards.end(), card->identification()) == job.cards.end()) {
+      continue;
+    }
+    // filename for this card
+    Context& ctx = set->getContext(card);
+    String filename = clean_filename(untag(ctx.eval(*filename_script)->toString()));
+    if (!filename) continue; // no filename -> no saving
+    fn.SetFullName(filename);
+    if (!resolve_filename_conflicts(fn, job.conflicts, used)) continue;
+    filename = fn.GetFullPath();
+    used.insert(filename);
+    // render and write, timing both steps separately
+    ExportBatchCardReport card_report;
+    card_report.card = card->identification();
+    card_report.file = filename;
+    wxStopWatch timer;
+    Image img = export_bitmap(set, card, &keys).ConvertToImage();
+    card_report.render_time = timer.Time();
+    timer.Start();
+    save_exported_image(img, filename, job.quality, job.width, job.height);
+    card_report.write_time = timer.Time();
+    report.cards.push_back(card_report);
+  }
+}
+
+bool export_image_batch(const String& manifest_filename, const String& report_filename) {
+  wxStopWatch total_timer;
+  // read manifest
+  ExportBatch batch;
+  {
+    wxFileInputStream file(manifest_filename);
+    if (!file.IsOk()) throw Error(_("Unable to open export manifest: ") + manifest_filename);
+    Reader reader(file, nullptr, manifest_filename);
+    reader.handle_greedy(batch);
+  }
+  String manifest_dir = wxFileName(manifest_filename).GetPath();
+  // run jobs
+  //  each set is only opened once, games and stylesheets are shared through the package manager
+  ExportBatchReport report;
+  map<String,SetP> sets;
+  FOR_EACH_CONST(job, batch.jobs) {
+    report.jobs.push_back(ExportBatchJobReport());
+    ExportBatchJobReport& job_report = report.jobs.back();
+    job_report.set = job.set;
+    wxStopWatch job_timer;
+    try {
+      String set_filename = batch_path(job.set, manifest_dir);
+      SetP& set = sets[set_filename];
+      if (!set) {
+        set = import_set(set_filename);
+        job_report.load_time = job_timer.Time();
+      }
+      export_job(job, set, job_report, manifest_dir);
+    } catch (const Error& e) {
+      job_report.error = e.what();
+      report.errors++;
+      handle_error(e);
+    }
+    job_report.total_time = job_timer.Time();
+  }
+  report.total_time = total_timer.Time();
+  // write report
+  if (report_filename.empty()) {
+    wxStringOutputStream stream;
+    {
+      Writer writer(stream, app_version);
+      writer.handle(report);
+    }
+    String out = stream.GetString();
+    if (!out.empty() && out[0] == BYTE_ORDER_MARK[0]) out.erase(0,1);
+    cli << out;
+    cli.flush();
+  } else {
+    wxFileOutputStream stream(report_filename);
+    if (!stream.IsOk()) throw Error(_("Unable to write export report: ") + report_filename);
+    Writer writer(stream, app_version);
+    writer.handle(report);
+  }
+  return report.errors == 0;
+}
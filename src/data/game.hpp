@@ -76,6 +76,7 @@ public:
   
 protected:
   void validate(Version) override;
+  bool cacheScripts() const override;
   
   DECLARE_REFLECTION_OVERRIDE();
 };
@@ -17,11 +17,14 @@
 #include <data/field/text.hpp>    // for 0.2.7 fix
 #include <data/field/information.hpp>
 #include <util/tagged_string.hpp> // for 0.2.7 fix
+#include <data/card_search_index.hpp>
 #include <util/order_cache.hpp>
 #include <util/delayed_index_maps.hpp>
 #include <script/script_manager.hpp>
 #include <script/profiler.hpp>
+#include <gfx/decoded_image_cache.hpp>
 #include <wx/sstream.h>
+#include <wx/thread.h>
 
 // ----------------------------------------------------------------------------- : Set
 
@@ -104,6 +107,16 @@ IndexMap<FieldP, ValueP>& Set::stylingDataFor(const CardP& card) {
   else                           return stylingDataFor(stylesheetFor(card));
 }
 
+KeywordDatabase& Set::keywordDatabase() {
+  if (keyword_db.empty()) {
+    keyword_db.prepare_parameters(game->keyword_parameter_types, keywords);
+    keyword_db.prepare_parameters(game->keyword_parameter_types, game->keywords);
+    keyword_db.add(keywords);
+    keyword_db.add(game->keywords);
+  }
+  return keyword_db;
+}
+
 String Set::identification() const {
   // an identifying field
   FOR_EACH_CONST(v, data) {
@@ -162,6 +175,8 @@ void Set::validate(Version file_app_version) {
 */  }
   // we want at least one card
   if (cards.empty()) cards.push_back(make_intrusive<Card>(*game));
+  // the images of the stylesheet will be needed soon, decode them while the scripts are updated
+  decoded_image_cache.prefetch(stylesheet);
   // update scripts
   script_manager->updateAll();
 }
@@ -246,6 +261,124 @@ void Set::reflect_cards<Writer> (Writer& handler) {
   }
 }
 
+/// Does a card have its own stylesheet? Reading it can load a package
+bool has_own_stylesheet(const Reader::UnparsedBlock& block) {
+  return block.text.compare(0, 11, "stylesheet:") == 0 || block.text.find("\nstylesheet:") != std::string::npos;
+}
+
+/// Parse a card that was read with Reader::handleUnparsed
+/** Warnings are added to warnings, so they can be shown once for the whole file */
+CardP read_card(const Reader& parent, const Reader::UnparsedBlock& block, String& warnings) {
+  Reader reader(block, parent);
+  CardP card;
+  try {
+    reader.handle_greedy(card);
+  } catch (...) {
+    warnings += reader.takeWarnings();
+    throw;
+  }
+  warnings += reader.takeWarnings();
+  return card;
+}
+
+/// Thread that parses a range of cards
+/** Cards with their own stylesheet are skipped, the main thread reads those afterwards.
+ */
+class CardReadThread : public wxThread {
+public:
+  CardReadThread(const Reader& parent, const vector<Reader::UnparsedBlock>& blocks, CardP* cards, size_t begin, size_t end)
+    : wxThread(wxTHREAD_JOINABLE)
+    , parent(parent), blocks(blocks), cards(cards), begin(begin), end(end)
+    , game(game_for_reading()), stylesheet(stylesheet_for_reading())
+  {}
+  
+  String error;    ///< Error while reading, rethrown by the main thread
+  String warnings; ///< Warnings while reading, shown by the main thread
+  
+  /// Parse the cards, on the current thread
+  void read() {
+    WITH_DYNAMIC_ARG(game_for_reading, game);
+    WITH_DYNAMIC_ARG(stylesheet_for_reading, stylesheet);
+    try {
+      for (size_t i = begin ; i < end ; ++i) {
+        if (!has_own_stylesheet(blocks[i])) cards[i] = read_card(parent, blocks[i], warnings);
+      }
+    } catch (const Error& e) {
+      error = e.what();
+    } catch (const std::exception& e) {
+      // exceptions can't leave the thread
+      error = String(e.what(), IF_UNICODE(wxConvLocal, wxSTRING_MAXLEN));
+    } catch (...) {
+      error = _("An unexpected exception occurred!");
+    }
+  }
+  
+protected:
+  ExitCode Entry() override {
+    read();
+    return 0;
+  }
+  
+private:
+  const Reader& parent;
+  const vector<Reader::UnparsedBlock>& blocks;
+  CardP* cards;
+  size_t begin, end;
+  Game* game;
+  StyleSheet* stylesheet;
+};
+
+const size_t MIN_CARDS_PER_READ_THREAD = 64;
+
+template <>
+void Set::reflect_cards<Reader> (Reader& handler) {
+  // First find the text of the cards, that is cheap.
+  // Then parse the cards, for large sets on multiple threads.
+  vector<Reader::UnparsedBlock> blocks;
+  handler.handleUnparsed(_("card"), blocks);
+  if (blocks.empty()) return;
+  size_t first = cards.size(); // cards can come from multiple files
+  cards.resize(first + blocks.size());
+  CardP* new_cards = &cards[first];
+  int thread_count = min(wxThread::GetCPUCount(), (int)(blocks.size() / MIN_CARDS_PER_READ_THREAD));
+  if (thread_count > 1) {
+    vector<unique_ptr<CardReadThread>> threads;
+    vector<bool> running;
+    for (int t = 0 ; t < thread_count ; ++t) {
+      size_t begin = blocks.size() *  t      / thread_count;
+      size_t end   = blocks.size() * (t + 1) / thread_count;
+      threads.push_back(make_unique<CardReadThread>(handler, blocks, new_cards, begin, end));
+      running.push_back(threads.back()->Run() == wxTHREAD_NO_ERROR);
+    }
+    String error;
+    for (size_t t = 0 ; t < threads.size() ; ++t) {
+      if (running[t]) {
+        threads[t]->Wait();
+      } else {
+        threads[t]->read(); // the thread could not be started, do it here
+      }
+      if (error.empty()) error = threads[t]->error;
+      handler.addWarnings(threads[t]->warnings);
+    }
+    if (!error.empty()) {
+      cards.resize(first); // don't leave cards that were not read
+      throw ParseError(error);
+    }
+  }
+  // the cards that were not read by a thread
+  String warnings;
+  try {
+    for (size_t i = 0 ; i < blocks.size() ; ++i) {
+      if (!new_cards[i]) new_cards[i] = read_card(handler, blocks[i], warnings);
+    }
+  } catch (...) {
+    cards.resize(first);
+    handler.addWarnings(warnings);
+    throw;
+  }
+  handler.addWarnings(warnings);
+}
+
 // ----------------------------------------------------------------------------- : Script utilities
 
 ScriptValueP make_iterator(const Set& set) {
@@ -253,6 +386,11 @@ ScriptValueP make_iterator(const Set& set) {
 }
 
 void mark_dependency_member(const Set& set, const String& name, const Dependency& dep) {
+  // is this a check whether a script uses the set? then set dep.index=true
+  if (dep.type == DEP_DUMMY && dep.data == &set) {
+    const_cast<Dependency&>(dep).index = true;
+    return;
+  }
   // is it the card list?
   if (name == _("cards")) {
     set.game->dependent_scripts_cards.add(dep);
@@ -274,47 +412,71 @@ void reflect_set_info_get_member(GetMember& handler, const IndexMap<FieldP, Valu
   REFLECT_NAMELESS(data);
 }
 
-int Set::positionOfCard(const CardP& card, const ScriptValueP& order_by, const ScriptValueP& filter) {
-  // TODO : Lock the map?
-  assert(order_by);
-  OrderCacheP& order = order_cache[make_pair(order_by,filter)];
+/// Functions passed as order_by or filter can be new objects on each call, don't remember too many of them
+const size_t MAX_ORDER_CACHES = 64;
+
+OrderCacheP Set::orderCache(const ScriptValueP& order_by, const ScriptValueP& filter) {
+  wxMutexLocker locker(order_cache_lock);
+  auto key = make_pair(order_by, filter);
+  auto it = order_cache.find(key);
+  OrderCacheP order;
+  if (it != order_cache.end() && it->second->keyCount() == cards.size()) {
+    order = it->second; // otherwise cards were added or removed without telling us
+  }
   if (!order) {
     // 1. make a list of the order value for each card
     vector<String> values; values.reserve(cards.size());
     vector<int>    keep;   if(filter) keep.reserve(cards.size());
     FOR_EACH_CONST(c, cards) {
       Context& ctx = getContext(c);
-      values.push_back(order_by->eval(ctx)->toString());
+      values.push_back(order_by ? order_by->eval(ctx)->toString() : String());
       if (filter) {
         keep.push_back(filter->eval(ctx)->toBool());
       }
     }
     #if USE_SCRIPT_PROFILING
       Timer t;
-      Profiler prof(t, order_by.get(), _("init order cache"));
+      Profiler prof(t, order_by ? order_by.get() : filter.get(), _("init order cache"));
     #endif
     // 3. initialize order cache
     order = make_intrusive<OrderCache<CardP>>(cards, values, filter ? &keep : nullptr);
+    if (order_cache.size() >= MAX_ORDER_CACHES) order_cache.clear();
+    order_cache[key] = order;
+  } else {
+    // only re-evaluate the cards that changed
+    order->updateInvalidated([&](const CardP& c, String& value, bool& keep) {
+      Context& ctx = getContext(c);
+      if (order_by) value = order_by->eval(ctx)->toString();
+      if (filter)   keep  = filter->eval(ctx)->toBool();
+    });
   }
-  return order->find(card);
+  return order;
+}
+
+int Set::positionOfCard(const CardP& card, const ScriptValueP& order_by, const ScriptValueP& filter) {
+  assert(order_by);
+  return orderCache(order_by, filter)->find(card);
 }
 int Set::numberOfCards(const ScriptValueP& filter) {
   if (!filter) return (int)cards.size();
-  map<ScriptValueP,int>::const_iterator it = filter_cache.find(filter);
-  if (it !=filter_cache.end()) {
-    return it->second;
-  } else {
-    int n = 0;
-    FOR_EACH_CONST(c, cards) {
-      if (filter->eval(getContext(c))->toBool()) ++n;
-    }
-    filter_cache.insert(make_pair(filter,n));
-    return n;
+  return orderCache(ScriptValueP(), filter)->size();
+}
+
+CardSearchIndex& Set::searchIndex() {
+  if (!search_index) {
+    search_index = make_unique<CardSearchIndex>(*this);
   }
+  return *search_index;
 }
 void Set::clearOrderCache() {
+  wxMutexLocker locker(order_cache_lock);
   order_cache.clear();
-  filter_cache.clear();
+}
+void Set::clearOrderCache(const CardP& card) {
+  wxMutexLocker locker(order_cache_lock);
+  FOR_EACH(order, order_cache) {
+    order.second->invalidate(card);
+  }
 }
 
 // ----------------------------------------------------------------------------- : SetView
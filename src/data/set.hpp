@@ -14,6 +14,7 @@
 #include <util/io/package.hpp>
 #include <data/field.hpp> // for Set::value
 #include <data/keyword.hpp>
+#include <wx/thread.h>
 
 DECLARE_POINTER_TYPE(Card);
 DECLARE_POINTER_TYPE(Set);
@@ -29,6 +30,7 @@ class SetScriptManager;
 class SetScriptContext;
 class Context;
 class Dependency;
+class CardSearchIndex;
 template <typename> class OrderCache;
 typedef intrusive_ptr<OrderCache<CardP>> OrderCacheP;
 
@@ -91,6 +93,9 @@ public:
   /// Styling information for a particular card
   IndexMap<FieldP, ValueP>& stylingDataFor(const CardP& card);
   
+  /// The keyword database, filled with the keywords of the set and game if it was cleared
+  KeywordDatabase& keywordDatabase();
+  
   /// Get the identification of this set, an identification is something like a name, title, etc.
   /** May return "" */
   String identification() const;
@@ -113,6 +118,12 @@ public:
   int numberOfCards(const ScriptValueP& filter);
   /// Clear the order_cache used by positionOfCard
   void clearOrderCache();
+  /// The values of a card have changed, the order_cache only needs to re-evaluate that card
+  void clearOrderCache(const CardP& card);
+  
+  /// Index for quickly searching the cards in this set
+  /** Should only be used from the main thread! */
+  CardSearchIndex& searchIndex();
   
   String typeName() const override;
   Version fileVersion() const override;
@@ -133,9 +144,14 @@ private:
   unique_ptr<SetScriptManager> script_manager;
   /// Object for executing scripts from the thumbnail thread
   unique_ptr<SetScriptContext> thumbnail_script_context;
-  /// Cache of cards ordered by some criterion
+  /// Cache of cards ordered by some criterion and filtered, numberOfCards uses the ones without order
   map<pair<ScriptValueP,ScriptValueP>,OrderCacheP> order_cache;
-  map<ScriptValueP,int>                            filter_cache;
+  /// Lock for order_cache, scripts evaluated on other threads (e.g. for statistics) can use it
+  wxMutex order_cache_lock{wxMUTEX_RECURSIVE};
+  /// Get an up to date order cache
+  OrderCacheP orderCache(const ScriptValueP& order_by, const ScriptValueP& filter);
+  /// Index of the card values, created when it is first used
+  unique_ptr<CardSearchIndex> search_index;
 };
 
 inline String type_name(const Set&) {
@@ -146,6 +162,8 @@ inline int item_count(const Set& set) {
 }
 ScriptValueP make_iterator(const Set& set);
 
+/// Mark a dependency on a member of the set
+/** If dep.type == DEP_DUMMY and dep.data == &set, this sets dep.index=true instead */
 void mark_dependency_member(const Set& set, const String& name, const Dependency& dep);
 
 // ----------------------------------------------------------------------------- : SetView
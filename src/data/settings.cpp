@@ -171,6 +171,8 @@ Settings::Settings()
   , symbol_grid_size     (30)
   , symbol_grid          (true)
   , symbol_grid_snap     (false)
+  , render_cache         (false)
+  , script_update_threads(0)
   , print_layout         (LAYOUT_NO_SPACE)
   #if USE_OLD_STYLE_UPDATE_CHECKER
   , updates_url          (_("http://magicseteditor.sourceforge.net/updates"))
@@ -276,6 +278,8 @@ IMPLEMENT_REFLECTION_NO_SCRIPT(Settings) {
   REFLECT(stylesheet_settings);
   REFLECT(default_stylesheet_settings);
   REFLECT(export_options);
+  REFLECT(render_cache);
+  REFLECT(script_update_threads);
 }
 
 void Settings::clear() {
@@ -185,6 +185,12 @@ public:
   /// Get the options for an export template
   IndexMap<FieldP,ValueP>& exportOptionsFor(const ExportTemplate& export_template);
   
+  bool render_cache; ///< Keep rendered card images on disk, so unchanged cards need not be drawn again when exporting
+  
+  // --------------------------------------------------- : Scripts
+  
+  int script_update_threads; ///< Threads for updating all cards of a set, 0 = one per processor, 1 = only the main thread
+  
   // --------------------------------------------------- : Printing
   
   PageLayoutType print_layout;
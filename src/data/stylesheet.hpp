@@ -68,6 +68,7 @@ public:
   void validate(Version = app_version) override;
   
 protected:
+  bool cacheScripts() const override;
   
   DECLARE_REFLECTION();
 };
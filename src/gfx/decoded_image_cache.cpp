@@ -0,0 +1,196 @@
+//+----------------------------------------------------------------------------+
+//| Description:  Magic Set Editor - Program to make Magic (tm) cards          |
+//| Copyright:    (C) Twan van Laarhoven and the other MSE developers          |
+//| License:      GNU General Public License 2 or later (see file COPYING)     |
+//+----------------------------------------------------------------------------+
+
+// ----------------------------------------------------------------------------- : Includes
+
+#include <util/prec.hpp>
+#include <gfx/decoded_image_cache.hpp>
+#include <util/io/package.hpp>
+#include <util/error.hpp>
+#include <gui/util.hpp> // image_load_file
+
+DecodedImageCache decoded_image_cache;
+
+/// Number of threads used for prefetching
+const int PREFETCH_THREADS = 2;
+
+// ----------------------------------------------------------------------------- : Decoding
+
+/// Decode an image file from a package, returns an invalid image if that fails
+Image decode_image(Package& package, const String& filename) {
+  auto stream = package.openIn(filename);
+  Image image;
+  if (!image_load_file(image, *stream)) return Image();
+  if (image.HasMask()) image.InitAlpha(); // we can't handle masks
+  return image;
+}
+
+/// Memory used by an image
+size_t image_size(const Image& image) {
+  return (size_t)image.GetWidth() * image.GetHeight() * (image.HasAlpha() ? 4 : 3);
+}
+
+/// Is a file in a package an image that can be prefetched?
+bool is_image_file(const String& filename) {
+  String ext = filename.AfterLast(_('.')).Lower();
+  return ext == _("png") || ext == _("jpg") || ext == _("jpeg") || ext == _("bmp") || ext == _("gif");
+}
+
+// ----------------------------------------------------------------------------- : ImagePrefetchThread
+
+/// Thread that decodes the images in DecodedImageCache::to_prefetch
+class ImagePrefetchThread : public wxThread {
+public:
+  ImagePrefetchThread(DecodedImageCache& cache)
+    : wxThread(wxTHREAD_JOINABLE)
+    , cache(cache)
+  {}
+
+protected:
+  ExitCode Entry() override {
+    while (true) {
+      intrusive_ptr<Package> package;
+      String filename;
+      {
+        wxMutexLocker locker(cache.lock);
+        while (cache.to_prefetch.empty() && !cache.stopping) {
+          cache.prefetch_work.Wait();
+        }
+        if (cache.stopping) return 0;
+        package  = cache.to_prefetch.front().first;
+        filename = cache.to_prefetch.front().second;
+        cache.to_prefetch.pop_front();
+        if (cache.used >= cache.budget / 4) {
+          cache.to_prefetch.clear(); // prefetched images should leave room for the images that are really used
+          continue;
+        }
+      }
+      try {
+        cache.load(*package, filename, true);
+      } catch (const Error&) {
+        // ignore, the error is reported when the image is actually used
+      }
+    }
+  }
+
+private:
+  DecodedImageCache& cache;
+};
+
+// ----------------------------------------------------------------------------- : DecodedImageCache
+
+DecodedImageCache::DecodedImageCache(size_t budget)
+  : budget(budget), used(0)
+  , decoded(lock), prefetch_work(lock)
+  , stopping(false)
+{}
+
+DecodedImageCache::~DecodedImageCache() {
+  stop();
+}
+
+Image DecodedImageCache::load(Package& package, const String& filename) {
+  return load(package, filename, false);
+}
+
+Image DecodedImageCache::load(Package& package, const String& filename, bool prefetching) {
+  String key = package.fileStamp(filename);
+  if (key.empty()) {
+    // not a known file, it can't be cached
+    return prefetching ? Image() : decode_image(package, filename);
+  }
+  {
+    wxMutexLocker locker(lock);
+    while (true) {
+      auto it = index.find(key);
+      if (it != index.end()) {
+        if (prefetching) return Image();
+        entries.splice(entries.begin(), entries, it->second); // now most recently used
+        return it->second->image.Copy();
+      }
+      if (decoding.find(key) == decoding.end()) break;
+      if (prefetching) return Image();
+      decoded.Wait(); // another thread is decoding this image, use its result
+    }
+    decoding.insert(key);
+  }
+  Image image;
+  try {
+    image = decode_image(package, filename);
+  } catch (...) {
+    wxMutexLocker locker(lock);
+    decoding.erase(key);
+    decoded.Broadcast();
+    throw;
+  }
+  wxMutexLocker locker(lock);
+  decoding.erase(key);
+  decoded.Broadcast();
+  if (image.Ok()) store(key, image, prefetching);
+  return image;
+}
+
+void DecodedImageCache::store(const String& key, const Image& image, bool prefetching) {
+  size_t size = image_size(image);
+  if (size > budget / 4) return; // too large, it would push out too many other images
+  // the cache keeps a copy of its own, the image can't be shared between threads
+  Entry entry = {key, image.Copy(), size};
+  // prefetched images are forgotten first if they are not used
+  auto it = prefetching ? entries.insert(entries.end(), entry) : entries.insert(entries.begin(), entry);
+  index[key] = it;
+  used += size;
+  while (used > budget && !entries.empty()) {
+    used -= entries.back().size;
+    index.erase(entries.back().key);
+    entries.pop_back();
+  }
+}
+
+void DecodedImageCache::prefetch(const intrusive_ptr<Package>& package) {
+  assert(wxThread::IsMain());
+  wxMutexLocker locker(lock);
+  if (stopping) return;
+  FOR_EACH_CONST(f, package->getFileInfos()) {
+    if (is_image_file(f.first)) {
+      to_prefetch.push_back(make_pair(package, f.first));
+    }
+  }
+  if (to_prefetch.empty()) return;
+  // start the threads the first time they are needed
+  if (prefetch_threads.empty()) {
+    for (int i = 0 ; i < PREFETCH_THREADS ; ++i) {
+      auto thread = make_unique<ImagePrefetchThread>(*this);
+      thread->SetPriority(WXTHREAD_MIN_PRIORITY);
+      if (thread->Run() != wxTHREAD_NO_ERROR) break;
+      prefetch_threads.push_back(move(thread));
+    }
+    if (prefetch_threads.empty()) {
+      to_prefetch.clear(); // no threads, the images will be decoded when they are used
+      return;
+    }
+  }
+  prefetch_work.Broadcast();
+}
+
+void DecodedImageCache::stop() {
+  {
+    wxMutexLocker locker(lock);
+    stopping = true;
+    to_prefetch.clear();
+    prefetch_work.Broadcast();
+  }
+  FOR_EACH(thread, prefetch_threads) {
+    thread->Wait();
+  }
+  prefetch_threads.clear();
+}
+
+void DecodedImageCache::clear() {
+  wxMutexLocker locker(lock);
+  entries.clear();
+  index.clear();
+  used = 0;
+}
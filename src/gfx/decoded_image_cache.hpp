@@ -0,0 +1,72 @@
+//+----------------------------------------------------------------------------+
+//| Description:  Magic Set Editor - Program to make Magic (tm) cards          |
+//| Copyright:    (C) Twan van Laarhoven and the other MSE developers          |
+//| License:      GNU General Public License 2 or later (see file COPYING)     |
+//+----------------------------------------------------------------------------+
+
+#pragma once
+
+// ----------------------------------------------------------------------------- : Includes
+
+#include <util/prec.hpp>
+#include <wx/thread.h>
+#include <list>
+#include <deque>
+
+class Package;
+class ImagePrefetchThread;
+
+// ----------------------------------------------------------------------------- : DecodedImageCache
+
+/// Images decoded from files in packages, shared by everything that loads images
+/** Images are remembered by their Package::fileStamp, so a changed file is decoded again.
+ *  When the images take up more memory than the budget, the least recently used ones are forgotten.
+ *
+ *  The image files of a package can be decoded in advance by background threads, see prefetch().
+ *  The cache can be used from multiple threads.
+ */
+class DecodedImageCache {
+public:
+  DecodedImageCache(size_t budget = 256 * 1024 * 1024);
+  ~DecodedImageCache();
+
+  /// Load an image from a file in a package, returns an invalid image if the file can't be decoded
+  /** The result is not shared with the cache, so it can be modified. */
+  Image load(Package& package, const String& filename);
+
+  /// Decode the image files in a package in the background, while they fit in a quarter of the budget
+  /** Should be called from the main thread */
+  void prefetch(const intrusive_ptr<Package>& package);
+  /// Stop the background threads, should be called before the program exits
+  void stop();
+
+  /// Forget all images
+  void clear();
+
+private:
+  struct Entry {
+    String key;
+    Image  image;
+    size_t size; ///< Memory used by the image
+  };
+  typedef std::list<Entry> Entries;
+
+  size_t budget, used;
+  wxMutex lock;
+  wxCondition decoded;  ///< Signaled when a thread is done decoding an image
+  Entries entries;      ///< most recently used first
+  unordered_map<String,Entries::iterator> index;
+  set<String> decoding; ///< Images that some thread is decoding
+
+  wxCondition prefetch_work; ///< Signaled when there are files to prefetch, or when stopping
+  deque<pair<intrusive_ptr<Package>,String>> to_prefetch;
+  vector<unique_ptr<ImagePrefetchThread>> prefetch_threads;
+  bool stopping;
+  friend class ImagePrefetchThread;
+
+  Image load(Package& package, const String& filename, bool prefetching);
+  void store(const String& key, const Image& image, bool prefetching);
+};
+
+/// The global decoded image cache
+extern DecodedImageCache decoded_image_cache;
@@ -8,6 +8,7 @@
 
 #include <util/prec.hpp>
 #include <gfx/generated_image.hpp>
+#include <gfx/decoded_image_cache.hpp>
 #include <util/io/package.hpp>
 #include <util/error.hpp>
 #include <data/symbol.hpp>
@@ -495,10 +496,8 @@ Image PackagedImage::generate(const Options& opt) const {
   // TODO : use opt.width and opt.height?
   // open file from package
   if (!opt.package) throw ScriptError(_("Can only load images in a context where an image is expected"));
-  auto file_stream = opt.package->openIn(filename);
-  Image img;
-  if (image_load_file(img, *file_stream)) {
-    if (img.HasMask()) img.InitAlpha(); // we can't handle masks
+  Image img = decoded_image_cache.load(*opt.package, filename);
+  if (img.Ok()) {
     return img;
   } else {
     throw ScriptError(_("Unable to load image '") + filename + _("' from '" + opt.package->name() + _("'")));
@@ -572,8 +571,7 @@ Image ImageValueToImage::generate(const Options& opt) const {
   if (!opt.local_package) throw ScriptError(_("Can only load images in a context where an image is expected"));
   Image image;
   if (!filename.empty()) {
-    auto image_file_stream = opt.local_package->openIn(filename);
-    image_load_file(image, *image_file_stream);
+    image = decoded_image_cache.load(*opt.local_package, filename.toStringForKey());
   }
   if (!image.Ok()) {
     image = Image(max(1,opt.width), max(1,opt.height));
@@ -69,6 +69,7 @@ struct Freezer{
 void CardListBase::onAction(const Action& action, bool undone) {
   TYPE_CASE(action, AddCardAction) {
     Freezer freeze(this);
+    clearColumns(); // the memory of removed cards can be reused by new ones
     if (action.action.adding != undone) {
       // select the new cards
       focusNone();
@@ -103,12 +104,18 @@ void CardListBase::onAction(const Action& action, bool undone) {
     RefreshItem((long)action.card_id1);
     RefreshItem((long)action.card_id2);
   }
-  TYPE_CASE_(action, ScriptValueEvent) {
+  TYPE_CASE(action, ScriptValueEvent) {
     // No refresh needed, a ScriptValueEvent is only generated in response to a ValueAction
+    auto it = card_rows.find(action.card);
+    if (it != card_rows.end()) updateRow(*action.card, it->second);
     return;
   }
   TYPE_CASE(action, ValueAction) {
-    if (action.card) refreshList(true);
+    if (action.card) {
+      auto it = card_rows.find(action.card.get());
+      if (it != card_rows.end()) updateRow(*action.card, it->second);
+      refreshList(true);
+    }
   }
 }
 
@@ -185,26 +192,86 @@ bool CardListBase::doDelete() {
 
 // Comparison object for comparing cards
 bool CardListBase::compareItems(void* a, void* b) const {
-  FieldP sort_field = column_fields[sort_by_column];
-  ValueP va = reinterpret_cast<Card*>(a)->data[sort_field];
-  ValueP vb = reinterpret_cast<Card*>(b)->data[sort_field];
-  assert(va && vb);
+  size_t row_a = cardRow(*reinterpret_cast<Card*>(a));
+  size_t row_b = cardRow(*reinterpret_cast<Card*>(b));
+  return compareRows(row_a, row_b);
+}
+
+bool CardListBase::compareRows(size_t a, size_t b) const {
   // compare sort keys
-  int cmp = smart_compare( va->getSortKey(), vb->getSortKey() );
+  const ColumnValues& column = columns[sort_by_column];
+  int cmp = smart_compare( column.sortKey(a), column.sortKey(b) );
   if (cmp != 0) return cmp < 0;
   // equal values, compare alternate sort key
   if (alternate_sort_field) {
-    ValueP va = reinterpret_cast<Card*>(a)->data[alternate_sort_field];
-    ValueP vb = reinterpret_cast<Card*>(b)->data[alternate_sort_field];
-    int cmp = smart_compare( va->getSortKey(), vb->getSortKey() );
+    int cmp = smart_compare( alternate_column.sortKey(a), alternate_column.sortKey(b) );
     if (cmp != 0) return cmp < 0;
   }
   return false;
 }
 
+void CardListBase::sortItems(vector<VoidP>& items) {
+  // sort (row, position) pairs, so the snapshot is only searched once for each card
+  vector<pair<size_t,size_t>> rows;
+  rows.reserve(items.size());
+  for (size_t i = 0 ; i < items.size() ; ++i) {
+    rows.push_back(make_pair(cardRow(*static_cast<Card*>(items[i].get())), i));
+  }
+  stable_sort(rows.begin(), rows.end(), [this](const pair<size_t,size_t>& a, const pair<size_t,size_t>& b) {
+    return sort_ascending ? compareRows(a.first, b.first) : compareRows(b.first, a.first);
+  });
+  vector<VoidP> sorted;
+  sorted.reserve(items.size());
+  FOR_EACH(r, rows) {
+    sorted.push_back(move(items[r.second]));
+  }
+  swap(items, sorted);
+}
+
+// ----------------------------------------------------------------------------- : CardListBase : Columns snapshot
+
+void CardListBase::ColumnValues::set(size_t row, const ValueP& value) {
+  if (row >= texts.size()) {
+    texts.resize(row + 1);
+    if (use_sort_keys) sort_keys.resize(row + 1);
+  }
+  texts[row] = value ? value->toString() : String();
+  if (use_sort_keys) sort_keys[row] = value ? value->getSortKey() : String();
+}
+
+void CardListBase::clearColumns() {
+  card_rows.clear();
+  columns.clear();
+  columns.resize(column_fields.size());
+  for (size_t i = 0 ; i < column_fields.size() ; ++i) {
+    columns[i].use_sort_keys = (bool)column_fields[i]->sort_script;
+  }
+  alternate_column = ColumnValues();
+  alternate_column.use_sort_keys = alternate_sort_field && alternate_sort_field->sort_script;
+}
+
+size_t CardListBase::cardRow(const Card& card) const {
+  auto it = card_rows.find(&card);
+  if (it != card_rows.end()) return it->second;
+  size_t row = card_rows.size();
+  card_rows.insert(make_pair(&card, row));
+  updateRow(card, row);
+  return row;
+}
+
+void CardListBase::updateRow(const Card& card, size_t row) const {
+  for (size_t i = 0 ; i < column_fields.size() ; ++i) {
+    columns[i].set(row, card.data.at(column_fields[i]->index));
+  }
+  if (alternate_sort_field) {
+    alternate_column.set(row, card.data.at(alternate_sort_field->index));
+  }
+}
+
 void CardListBase::rebuild() {
   ClearAll();
   column_fields.clear();
+  clearColumns();
   selected_item_pos = -1;
   onRebuild();
   if (!set) return;
@@ -250,6 +317,7 @@ void CardListBase::rebuild() {
       break;
     }
   }
+  clearColumns();
   // refresh
   refreshList();
 }
@@ -309,9 +377,8 @@ String CardListBase::OnGetItemText(long pos, long col) const {
     // wx may give us non existing columns!
     return wxEmptyString;
   }
-  ValueP val = getCard(pos)->data[column_fields[col]];
-  if (val) return val->toString();
-  else     return wxEmptyString;
+  size_t row = cardRow(*getCard(pos));
+  return columns[col].texts[row];
 }
 
 int CardListBase::OnGetItemImage(long pos) const {
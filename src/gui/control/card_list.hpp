@@ -108,6 +108,8 @@ protected:
   void sendEvent(int type = EVENT_CARD_SELECT);
   /// Compare cards
   bool compareItems(void* a, void* b) const override;
+  /// Sort cards, using the values in the columns snapshot
+  void sortItems(vector<VoidP>& items) override;
   
   // --------------------------------------------------- : Item 'events'
   
@@ -128,6 +130,32 @@ private:
   
   mutable wxListItemAttr item_attr; // for OnGetItemAttr
   
+  // snapshot of the values shown in the columns, so sorting and drawing don't have to ask the values
+  /// Values of the cards in a column, by row
+  struct ColumnValues {
+    bool           use_sort_keys = false; ///< Does the field have a sort script?
+    vector<String> texts;     ///< The text shown for each row
+    vector<String> sort_keys; ///< The key to sort each row by, if use_sort_keys
+    
+    /// Set the values in a row
+    void set(size_t row, const ValueP& value);
+    inline const String& sortKey(size_t row) const {
+      return use_sort_keys ? sort_keys[row] : texts[row];
+    }
+  };
+  mutable vector<ColumnValues> columns;          ///< Values of each column in column_fields
+  mutable ColumnValues         alternate_column; ///< Values of alternate_sort_field
+  mutable unordered_map<const Card*,size_t> card_rows; ///< Row of each card in the columns
+  
+  /// Forget the snapshot, for example because the cards or columns changed
+  void clearColumns();
+  /// Row of a card in the snapshot, its values are determined if it isn't in there yet
+  size_t cardRow(const Card& card) const;
+  /// Determine the values of a card in the snapshot
+  void updateRow(const Card& card, size_t row) const;
+  /// Compare two rows of the snapshot, like compareItems
+  bool compareRows(size_t a, size_t b) const;
+  
 public:
   /// Open a dialog for selecting columns to be shown
   void selectColumns();
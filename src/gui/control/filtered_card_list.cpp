@@ -17,7 +17,12 @@ FilteredCardList::FilteredCardList(Window* parent, int id, long additional_style
 
 void FilteredCardList::setFilter(const CardListFilterP& filter) {
   this->filter = filter;
-  rebuild();
+  // the columns stay the same, only the items have to be selected again
+  if (set && GetColumnCount() > 0) {
+    refreshList();
+  } else {
+    rebuild();
+  }
 }
 
 void FilteredCardList::onChangeSet() {
@@ -122,7 +122,12 @@ FilteredImageCardList::FilteredImageCardList(Window* parent, int id, long additi
 
 void FilteredImageCardList::setFilter(const CardListFilterP& filter) {
   this->filter = filter;
-  rebuild();
+  // the columns stay the same, only the items have to be selected again
+  if (set && GetColumnCount() > 0) {
+    refreshList();
+  } else {
+    rebuild();
+  }
 }
 
 void FilteredImageCardList::onChangeSet() {
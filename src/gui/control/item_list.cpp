@@ -163,6 +163,10 @@ struct ItemList::ItemComparer {
   }
 };
 
+void ItemList::sortItems(vector<VoidP>& items) {
+  stable_sort(items.begin(), items.end(), ItemComparer(*this));
+}
+
 void ItemList::refreshList(bool refresh_current_only) {
   // Get all items
   vector<VoidP> old_sorted_list;
@@ -170,7 +174,7 @@ void ItemList::refreshList(bool refresh_current_only) {
   getItems(sorted_list);
   // Sort the list
   if (sort_by_column >= 0) {
-    stable_sort(sorted_list.begin(), sorted_list.end(), ItemComparer(*this));
+    sortItems(sorted_list);
   }
   // Has the entire list changed?
   if (refresh_current_only && sorted_list == old_sorted_list) {
@@ -67,6 +67,9 @@ protected:
   virtual bool mustSort() const { return false; }
   /// Compare two items for < based on sort_by_column (not on sort_ascending)
   virtual bool compareItems(void* a, void* b) const = 0;
+  /// Sort items by sort_by_column and sort_ascending, keeping the order of equal items
+  /** By default compareItems is used, derived classes can do this in a faster way */
+  virtual void sortItems(vector<VoidP>& items);
   
   // --------------------------------------------------- : Protected interface
   /// Return the card at the given position in the sorted list
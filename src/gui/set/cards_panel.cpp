@@ -18,6 +18,7 @@
 #include <data/set.hpp>
 #include <data/game.hpp>
 #include <data/card.hpp>
+#include <data/card_search_index.hpp>
 #include <data/add_cards_script.hpp>
 #include <data/action/set.hpp>
 #include <data/settings.hpp>
@@ -344,7 +345,11 @@ void CardsPanel::onCommand(int id) {
     }
     case ID_CARD_FILTER: {
       // card filter has changed, update the card list
-      card_list->setFilter(filter->getFilter<Card>());
+      if (filter->hasFilter()) {
+        card_list->setFilter(make_intrusive<IndexedCardFilter>(set, filter->getFilterString()));
+      } else {
+        card_list->setFilter(CardListFilterP());
+      }
       break;
     }
     default: {
@@ -15,11 +15,16 @@
 #include <data/game.hpp>
 #include <data/statistics.hpp>
 #include <data/action/value.hpp>
+#include <data/action/set.hpp>
+#include <script/script_manager.hpp>
 #include <util/window_id.hpp>
 #include <util/alignment.hpp>
 #include <util/tagged_string.hpp>
 #include <gfx/gfx.hpp>
 #include <wx/splitter.h>
+#include <wx/thread.h>
+#include <wx/stopwatch.h>
+#include <unordered_set>
 
 // ----------------------------------------------------------------------------- : StatCategoryList
 #if !USE_DIMENSION_LISTS
@@ -269,10 +274,19 @@ void StatDimensionList::drawItem(DC& dc, int x, int y, size_t item) {
 #endif
 // ----------------------------------------------------------------------------- : StatsPanel
 
+/// Time in milliseconds to spend determining values at a time, before the graph is updated
+const long STATS_STEP_TIME = 100;
+/// Limits for the number of cards in a step, the number is adjusted to the time it takes
+const size_t MIN_STATS_CARDS_PER_STEP = 8;
+const size_t MAX_STATS_CARDS_PER_STEP = 16384;
+/// With fewer cards per thread, starting the threads costs more than it gains
+const size_t MIN_CARDS_PER_STATS_THREAD = 32;
+
 StatsPanel::StatsPanel(Window* parent, int id)
   : SetWindowPanel(parent, id)
   , menuGraph(nullptr)
   , up_to_date(true), active(false)
+  , shown_layout(GRAPH_TYPE_BAR), next_card(0), cards_per_step(MIN_STATS_CARDS_PER_STEP), computing(false)
 {
   // delayed initialization by initControls()
 }
@@ -328,6 +342,9 @@ StatsPanel::~StatsPanel() {
 
 void StatsPanel::onChangeSet() {
   if (!isInitialized()) return;
+  forgetValues(nullptr);
+  set_dependent.clear();
+  thread_contexts.clear();
   card_list->setSet(set);
   #if USE_SEPARATE_DIMENSION_LISTS
     for (int i = 0 ; i < 3 ; ++i) dimensions[i]->show(set->game);
@@ -342,11 +359,20 @@ void StatsPanel::onChangeSet() {
 
 void StatsPanel::onAction(const Action& action, bool undone) {
   if (!isInitialized()) return;
-  TYPE_CASE_(action, ScriptValueEvent) {
-    // ignore style only stuff
+  TYPE_CASE(action, ScriptValueEvent) {
+    // a value changed by a script, the graph is updated after the action that caused it
+    forgetValues(action.card);
+    return;
+  }
+  TYPE_CASE(action, ValueAction) {
+    forgetValues(action.card.get());
+  } else TYPE_CASE_(action, CardListAction) {
+    forgetRemovedCards();
+    forgetValues(nullptr, true); // the position of cards can have changed
   } else {
-    onChange();
+    forgetValues(nullptr); // dimensions can depend on anything
   }
+  onChange();
 }
 
 void StatsPanel::initUI   (wxToolBar* tb, wxMenuBar* mb) {
@@ -461,9 +487,19 @@ void StatsPanel::showCategory(const GraphType* prefer_layout) {
     // layout
     GraphType layout = cat.type;
   #endif
+  // determine values, the first part now, the rest later
+  shown_dims   = dims;
+  shown_layout = layout;
+  next_card    = 0;
+  computing    = !determineValues();
+  updateGraph();
+}
+
+void StatsPanel::updateGraph() {
+  const vector<StatsDimensionP>& dims = shown_dims;
   // create axes
   GraphDataPre d;
-  FOR_EACH(dim, dims) {
+  FOR_EACH_CONST(dim, dims) {
     d.axes.push_back(make_intrusive<GraphAxis>(
       dim->name,
       dim->colors.empty() ? AUTO_COLOR_EVEN : AUTO_COLOR_NO,
@@ -474,25 +510,19 @@ void StatsPanel::showCategory(const GraphType* prefer_layout) {
       )
     );
   }
-  // find values for each card
-  for (size_t i = 0 ; i < set->cards.size() ; ++i) {
-    Context& ctx = set->getContext(set->cards[i]);
+  // the known values for each card
+  for (size_t i = 0 ; i < next_card && i < set->cards.size() ; ++i) {
+    const Card* card = set->cards[i].get();
     GraphElementP e = make_intrusive<GraphElement>(i);
     bool show = true;
-    FOR_EACH(dim, dims) {
-      try {
-        String value = untag(dim->script.invoke(ctx)->toString());
-        e->values.push_back(value);
-        if (value.empty() && !dim->show_empty) {
-          // don't show this element
-          show = false;
-          break;
-        }
-      } catch (ScriptError const& e) {
-        handle_error(ScriptError(e.what() + _("\n  in script for statistics dimension '") + dim->name + _("'")));
+    FOR_EACH_CONST(dim, dims) {
+      auto it = values[dim.get()].find(card);
+      if (it == values[dim.get()].end() || !it->second.ok || (it->second.value.empty() && !dim->show_empty)) {
+        // don't show this element
         show = false;
         break;
       }
+      e->values.push_back(it->second.value);
     }
     if (show) {
       assert(e->values.size() == dims.size());
@@ -501,15 +531,181 @@ void StatsPanel::showCategory(const GraphType* prefer_layout) {
   }
   // split lists
   size_t dim_id = 0;
-  FOR_EACH(dim, dims) {
+  FOR_EACH_CONST(dim, dims) {
     if (dim->split_list) d.splitList(dim_id);
     ++dim_id;
   }
   // update graph and card list
-  graph->setLayout(layout, true);
+  graph->setLayout(shown_layout, true);
   graph->setData(d);
   filterCards();
 }
+
+void StatsPanel::onIdle(wxIdleEvent& ev) {
+  if (!computing) return;
+  if (!active) {
+    // continue when the panel is shown again
+    computing  = false;
+    up_to_date = false;
+    return;
+  }
+  computing = !determineValues();
+  updateGraph();
+  if (computing) ev.RequestMore();
+}
+
+// ----------------------------------------------------------------------------- : Determining values
+
+/// Thread that determines the values of statistics dimensions for a range of cards
+class StatsValueThread : public wxThread {
+public:
+  StatsValueThread(Set& set, SetScriptContext* scripts, const vector<StatsDimensionP>& dims, const vector<CardP>& cards, size_t begin, size_t end)
+    : wxThread(wxTHREAD_JOINABLE)
+    , begin(begin), end(end)
+    , set(set), scripts(scripts), dims(dims), cards(cards)
+  {}
+  
+  const size_t       begin, end; ///< Range of cards
+  vector<StatsValue> results;    ///< Values for each card in the range and each dimension
+  vector<String>     errors;     ///< Errors from the scripts, reported by the main thread afterwards
+  
+  /// Determine the values, on the current thread
+  void determine() {
+    for (size_t i = begin ; i < end ; ++i) {
+      Context& ctx = scripts ? scripts->getContext(cards[i]) : set.getContext(cards[i]);
+      FOR_EACH_CONST(dim, dims) {
+        try {
+          results.push_back(StatsValue{untag(dim->script.invoke(ctx)->toString()), true});
+        } catch (const Error& e) {
+          errors.push_back(e.what() + _("\n  in script for statistics dimension '") + dim->name + _("'"));
+          results.push_back(StatsValue{String(), false});
+        } catch (const std::exception& e) {
+          // exceptions can't leave the thread
+          errors.push_back(String(e.what(), IF_UNICODE(wxConvLocal, wxSTRING_MAXLEN)) + _("\n  in script for statistics dimension '") + dim->name + _("'"));
+          results.push_back(StatsValue{String(), false});
+        } catch (...) {
+          errors.push_back(_("An unexpected exception occurred!\n  in script for statistics dimension '") + dim->name + _("'"));
+          results.push_back(StatsValue{String(), false});
+        }
+      }
+    }
+  }
+  
+protected:
+  ExitCode Entry() override {
+    determine();
+    return 0;
+  }
+  
+private:
+  Set& set;
+  SetScriptContext* scripts; ///< Contexts to use, or nullptr to use those of the set
+  const vector<StatsDimensionP>& dims;
+  const vector<CardP>& cards;
+};
+
+bool StatsPanel::determineValues() {
+  wxStopWatch timer;
+  // find cards with missing values
+  vector<CardP> cards;
+  for ( ; next_card < set->cards.size() && cards.size() < cards_per_step ; ++next_card) {
+    const CardP& card = set->cards[next_card];
+    FOR_EACH_CONST(dim, shown_dims) {
+      const auto& dim_values = values[dim.get()];
+      if (dim_values.find(card.get()) == dim_values.end()) {
+        cards.push_back(card);
+        break;
+      }
+    }
+  }
+  if (!cards.empty()) {
+    int thread_count = min(wxThread::GetCPUCount(), (int)(cards.size() / MIN_CARDS_PER_STATS_THREAD));
+    vector<unique_ptr<StatsValueThread>> threads;
+    vector<bool> running;
+    if (thread_count > 1) {
+      // things that are initialized on first use should be initialized now, so the threads only read them
+      set->keywordDatabase();
+      FOR_EACH(card, cards) {
+        set->stylingDataFor(set->stylesheetFor(card));
+        set->stylingDataFor(card);
+      }
+      while (thread_contexts.size() < (size_t)thread_count) {
+        thread_contexts.push_back(make_unique<SetScriptContext>(*set));
+      }
+      // start the threads, each with a consecutive range of cards
+      for (int t = 0 ; t < thread_count ; ++t) {
+        size_t begin = cards.size() *  t      / thread_count;
+        size_t end   = cards.size() * (t + 1) / thread_count;
+        threads.push_back(make_unique<StatsValueThread>(*set, thread_contexts[t].get(), shown_dims, cards, begin, end));
+        running.push_back(threads.back()->Run() == wxTHREAD_NO_ERROR);
+      }
+    } else {
+      threads.push_back(make_unique<StatsValueThread>(*set, nullptr, shown_dims, cards, 0, cards.size()));
+      running.push_back(false);
+    }
+    // wait for them, and remember the values
+    for (size_t t = 0 ; t < threads.size() ; ++t) {
+      StatsValueThread& thread = *threads[t];
+      if (running[t]) {
+        thread.Wait();
+      } else {
+        thread.determine(); // the thread could not be started, do it here
+      }
+      FOR_EACH(e, thread.errors) {
+        handle_error(ScriptError(e));
+      }
+      size_t r = 0;
+      for (size_t i = thread.begin ; i < thread.end ; ++i) {
+        FOR_EACH_CONST(dim, shown_dims) {
+          values[dim.get()][cards[i].get()] = thread.results[r++];
+        }
+      }
+    }
+    // the next step should take about STATS_STEP_TIME
+    if (cards.size() >= cards_per_step) {
+      size_t step = (size_t)(cards.size() * STATS_STEP_TIME / max(1L, timer.Time()));
+      cards_per_step = min(MAX_STATS_CARDS_PER_STEP, max(MIN_STATS_CARDS_PER_STEP, step));
+    }
+  }
+  return next_card >= set->cards.size();
+}
+
+bool StatsPanel::isSetDependent(const StatsDimension& dim) {
+  auto it = set_dependent.find(&dim);
+  if (it != set_dependent.end()) return it->second;
+  if (set->cards.empty()) return false; // no values to forget, check later
+  Dependency test(DEP_DUMMY, false, set.get());
+  dim.script.initDependencies(set->getContext(set->cards.front()), test);
+  return set_dependent[&dim] = test.index != 0;
+}
+
+void StatsPanel::forgetValues(const Card* card, bool set_dependent_only) {
+  if (card || set_dependent_only) {
+    FOR_EACH(dim_values, values) {
+      if (isSetDependent(*dim_values.first)) {
+        // the script can use other cards or the set, so all values can have changed
+        dim_values.second.clear();
+      } else if (card) {
+        dim_values.second.erase(card);
+      }
+    }
+  } else {
+    values.clear();
+  }
+}
+
+void StatsPanel::forgetRemovedCards() {
+  // the memory of removed cards could be reused by new cards
+  unordered_set<const Card*> in_set;
+  FOR_EACH_CONST(card, set->cards) in_set.insert(card.get());
+  FOR_EACH(dim_values, values) {
+    auto& m = dim_values.second;
+    for (auto it = m.begin() ; it != m.end() ; ) {
+      if (in_set.find(it->first) == in_set.end()) it = m.erase(it);
+      else ++it;
+    }
+  }
+}
 void StatsPanel::showLayout(GraphType layout) {
   #if USE_DIMENSION_LISTS && !USE_SEPARATE_DIMENSION_LISTS
     // make sure we have the right number of data dimensions
@@ -552,6 +748,7 @@ void StatsPanel::filterCards() {
 
 BEGIN_EVENT_TABLE(StatsPanel, wxPanel)
   EVT_GRAPH_SELECT(wxID_ANY, StatsPanel::onGraphSelect)
+  EVT_IDLE        (StatsPanel::onIdle)
 END_EVENT_TABLE()
 
 // ----------------------------------------------------------------------------- : Selection
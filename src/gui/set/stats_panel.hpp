@@ -16,6 +16,8 @@ class StatCategoryList;
 class StatDimensionList;
 class GraphControl;
 class FilteredCardList;
+class SetScriptContext;
+DECLARE_POINTER_TYPE(StatsDimension);
 
 // Pick the style here:
 #define USE_DIMENSION_LISTS 1
@@ -23,7 +25,19 @@ class FilteredCardList;
 
 // ----------------------------------------------------------------------------- : StatsPanel
 
+/// The value of a statistics dimension for a card
+struct StatsValue {
+  String value;
+  bool   ok;    ///< Was the value determined without errors?
+};
+
 /// A panel for showing statistics on cards
+/** The values of the dimensions are remembered until a card changes,
+ *  or until anything changes for dimensions that use other cards or the set.
+ *  Missing values are determined on multiple threads, a part of the cards at a time,
+ *  the graph is updated after each part. Parts are sized to take about the same time.
+ *  The UI thread waits for each part, because the scripts read the set, which it could otherwise change.
+ */
 class StatsPanel : public SetWindowPanel {
 public:
   StatsPanel(Window* parent, int id);
@@ -63,12 +77,38 @@ private:
   bool up_to_date; ///< Are the graph and card list up to date?
   bool active;     ///< Is this panel selected?
   
+  /// Values of each dimension for each card
+  map<const StatsDimension*, unordered_map<const Card*, StatsValue>> values;
+  /// Contexts for determining values on other threads
+  vector<unique_ptr<SetScriptContext>> thread_contexts;
+  vector<StatsDimensionP> shown_dims;   ///< Dimensions of the graph
+  GraphType               shown_layout; ///< Layout of the graph
+  size_t                  next_card;    ///< Values of cards before this one are known
+  size_t                  cards_per_step; ///< Number of cards to determine values for at a time
+  /// Do the scripts of dimensions use the set, so that they can depend on other cards?
+  unordered_map<const StatsDimension*, bool> set_dependent;
+  bool                    computing;    ///< Are there values left to determine for the graph?
+  
   void initControls();
   
   void onChange();
   void onGraphSelect(wxCommandEvent&);
+  void onIdle(wxIdleEvent&);
   void showCategory(const GraphType* prefer_layout = nullptr);
   void showLayout(GraphType);
   void filterCards();
+  
+  /// Forget the values for a card, or for all cards if !card
+  /** Values of set dependent dimensions are forgotten for all cards.
+   *  With set_dependent_only, only those are forgotten. */
+  void forgetValues(const Card* card, bool set_dependent_only = false);
+  /// Does the script of a dimension use the set?
+  bool isSetDependent(const StatsDimension& dim);
+  /// Forget the values for cards that are no longer in the set
+  void forgetRemovedCards();
+  /// Determine missing values of shown_dims, for at most cards_per_step cards, returns true when all are known
+  bool determineValues();
+  /// Show the known values in the graph
+  void updateGraph();
 };
 
@@ -254,6 +254,7 @@ void SymbolWindow::onFileStore(wxCommandEvent& ev) {
     auto stream = package.openOut(new_filename);
     Writer writer(*stream, file_version_symbol);
     writer.handle(control->getSymbol());
+    writer.flush(); // the file is read when the value changes
     performer->addAction(value_action(value, new_filename));
   }
 }
@@ -15,6 +15,7 @@
 #include <data/locale.hpp>
 #include <data/installer.hpp>
 #include <data/format/formats.hpp>
+#include <script/script.hpp>
 #include <cli/cli_main.hpp>
 #include <cli/text_io_handler.hpp>
 #include <gui/welcome_window.hpp>
@@ -23,6 +24,7 @@
 #include <gui/set/window.hpp>
 #include <gui/symbol/window.hpp>
 #include <gui/thumbnail_thread.hpp>
+#include <gfx/decoded_image_cache.hpp>
 #include <wx/fs_inet.h>
 #include <wx/wfstream.h>
 #include <wx/txtstrm.h>
@@ -117,10 +119,15 @@ int MSE::OnRun() {
     // interpret command line
     {
       // ingnore the --color argument, it is handled by cli.init()
+      // --no-optimize can be combined with any other mode
       vector<String> args;
       for (int i = 1; i < argc; ++i) {
         args.push_back(argv[i]);
         if (args.back() == _("--color")) args.pop_back();
+        else if (args.back() == _("--no-optimize")) {
+          optimize_scripts = false;
+          args.pop_back();
+        }
       }
       if (!args.empty()) {
         const String& arg = args[0];
@@ -212,6 +219,11 @@ int MSE::OnRun() {
           cli << _("\n         \tQUALITY is the quality [0-100] of export all card images,");
           cli << _("\n         \tWIDTH is the width of export all card images,");
           cli << _("\n         \tHEIGHT is the height of export all card images.");
+          cli << _("\n\n  ") << BRIGHT << _("--export-batch") << NORMAL << PARAM << _(" MANIFEST") << NORMAL << _(" [") << PARAM << _("REPORT") << NORMAL << _("]");
+          cli << _("\n         \tExport card images for all jobs listed in the MANIFEST file.");
+          cli << _("\n         \tEach job gives a set, filename, quality, width, height, conflicts and optionally a list of cards.");
+          cli << _("\n         \tSets, games and stylesheets are only loaded once for all jobs.");
+          cli << _("\n         \tA report with timings for each card is written to REPORT, or to stdout.");
           cli << _("\n\n  ") << BRIGHT << _("--cli") << NORMAL << _(" [")
                              << PARAM << _("FILE") << NORMAL << _("] [")
                              << BRIGHT << _("--quiet") << NORMAL << _("] [")
@@ -219,6 +231,8 @@ int MSE::OnRun() {
           cli << _("\n         \tStart the command line interface for performing commands on the set file.");
           cli << _("\n         \tUse ") << BRIGHT << _("-q") << NORMAL << _(" or ") << BRIGHT << _("--quiet") << NORMAL << _(" to supress the startup banner and prompts.");
           cli << _("\n         \tUse ") << BRIGHT << _("-raw") << NORMAL << _(" for raw output mode.");
+          cli << _("\n\n  ") << BRIGHT << _("--no-optimize") << NORMAL;
+          cli << _("\n         \tDon't optimize scripts after parsing them, can be combined with the other options.");
           cli << _("\n\nRaw output mode is intended for use by other programs:");
           cli << _("\n    - The only output is only in response to commands.");
           cli << _("\n    - For each command a single 'record' is written to the standard output.");
@@ -281,6 +295,14 @@ int MSE::OnRun() {
           // export
           export_images(set, set->cards, path, out, CONFLICT_NUMBER_OVERWRITE, quality, out_width, out_height);
           return EXIT_SUCCESS;
+        } else if (arg == _("--export-batch")) {
+          if (args.size() < 2) {
+            handle_error(Error(_("No manifest file specified for --export-batch")));
+            return EXIT_FAILURE;
+          }
+          String report = args.size() >= 3 ? args[2] : _("");
+          if (!export_image_batch(args[1], report)) return EXIT_FAILURE;
+          return EXIT_SUCCESS;
         } else if (args[0] == _("--export_t")) {
           if (args.size() < 2) {
             throw Error(_("No export template specified for --export"));
@@ -320,6 +342,7 @@ int MSE::runGUI() {
 
 int MSE::OnExit() {
   thumbnail_thread.abortAll();
+  decoded_image_cache.stop();
   settings.write();
   package_manager.destroy();
   SpellChecker::destroyAll();
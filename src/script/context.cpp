@@ -109,7 +109,7 @@ ScriptValueP Context::eval(const Script& script, bool useScope) {
         
         // Get an object member
         case I_MEMBER_C: {
-          stack.back() = stack.back()->getMember(script.constants[i.data]->toString());
+          stack.back() = stack.back()->getMemberWithHint(script.constants[i.data]->toString(), script.member_hints[i.data]);
           break;
         }
         // Loop over a container, push next value or jump
@@ -331,6 +331,15 @@ ScriptValueP Context::makeClosure(const ScriptValueP& fun) {
   else        return closure;
 }
 
+void Context::getCallArguments(vector<pair<Variable,ScriptValueP>>& out) {
+  // same as makeClosure
+  for (size_t i = shadowed.size() - 1 ; i + 1 > 0 ; --i) {
+    Variable var = shadowed[i].variable;
+    if (variables[var].level < level) break;
+    out.push_back(make_pair(var, variables[var].value));
+  }
+}
+
 
 size_t Context::openScope() {
   level += 1;
@@ -73,6 +73,8 @@ public:
   
   /// Make a closure of the function with the direct parameters of the current call
   ScriptValueP makeClosure(const ScriptValueP& fun);
+  /// Get the direct parameters of the current call, i.e. the variables set in the current scope
+  void getCallArguments(vector<pair<Variable,ScriptValueP>>& out);
   
 public:
   
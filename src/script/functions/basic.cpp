@@ -331,7 +331,7 @@ SCRIPT_FUNCTION(to_lower) {
 }
 
 // convert a string to title case
-SCRIPT_FUNCTION(to_title) {
+SCRIPT_FUNCTION_PURE(to_title, SCRIPT_VAR_input) {
   SCRIPT_PARAM_C(String, input);
   SCRIPT_RETURN(capitalize(input.Lower()));
 }
@@ -371,13 +371,13 @@ SCRIPT_FUNCTION(contains) {
   SCRIPT_RETURN(input.find(match) != String::npos);
 }
 
-SCRIPT_FUNCTION(format) {
+SCRIPT_FUNCTION_PURE(format, SCRIPT_VAR_format, SCRIPT_VAR_input) {
   SCRIPT_PARAM_C(String, format);
   SCRIPT_PARAM_C(ScriptValueP, input);
   SCRIPT_RETURN(format_input(format,*input));
 }
 
-SCRIPT_FUNCTION(curly_quotes) {
+SCRIPT_FUNCTION_PURE(curly_quotes, SCRIPT_VAR_input) {
   SCRIPT_PARAM_C(String, input);
   SCRIPT_RETURN(curly_quotes(input,true));
 }
@@ -396,7 +396,7 @@ void sort_string(String& input) {
   input.clear();
   for (auto c : chars) input += c;
 }
-SCRIPT_FUNCTION(sort_text) {
+SCRIPT_FUNCTION_PURE(sort_text, SCRIPT_VAR_input, SCRIPT_VAR_order) {
   SCRIPT_PARAM_C(String, input);
   SCRIPT_OPTIONAL_PARAM_C(String, order) {
     SCRIPT_RETURN(spec_sort(order, input));
@@ -682,13 +682,7 @@ SCRIPT_FUNCTION_WITH_DEP(expand_keywords) {
   SCRIPT_OPTIONAL_PARAM_N_(ScriptValueP, _("condition"), match_condition);
   SCRIPT_OPTIONAL_PARAM_(ScriptValueP, default_expand);
   SCRIPT_PARAM(ScriptValueP, combine);
-  KeywordDatabase& db = set->keyword_db;
-  if (db.empty()) {
-    db.prepare_parameters(set->game->keyword_parameter_types, set->keywords);
-    db.prepare_parameters(set->game->keyword_parameter_types, set->game->keywords);
-    db.add(set->keywords);
-    db.add(set->game->keywords);
-  }
+  KeywordDatabase& db = set->keywordDatabase();
   SCRIPT_OPTIONAL_PARAM_C_(CardP, card);
   try {
     KeywordUsageStatistics* stat = card ? &card->keyword_usage : nullptr;
@@ -742,6 +736,14 @@ SCRIPT_FUNCTION(rule) {
   return make_intrusive<ScriptRule>(input);
 }
 
+// ----------------------------------------------------------------------------- : Memoization
+
+/// Remember the results of a function that only depends on its parameters
+SCRIPT_FUNCTION(memoize) {
+  SCRIPT_PARAM_C(ScriptValueP, input);
+  return make_intrusive<ScriptMemoized>(input);
+}
+
 // ----------------------------------------------------------------------------- : Init
 
 void init_script_basic_functions(Context& ctx) {
@@ -809,4 +811,6 @@ void init_script_basic_functions(Context& ctx) {
   ctx.setVariable(_("expand_keywords"),      script_expand_keywords);
   ctx.setVariable(_("expand_keywords_rule"), make_intrusive<ScriptRule>(script_expand_keywords));
   ctx.setVariable(_("keyword_usage"),        script_keyword_usage);
+  // memoization
+  ctx.setVariable(_("memoize"),              script_memoize);
 }
@@ -17,6 +17,7 @@
 #include <util/error.hpp>
 #include <script/to_value.hpp>
 #include <script/context.hpp>
+#include <script/memo.hpp>
 
 // ----------------------------------------------------------------------------- : Functions
 
@@ -50,6 +51,33 @@
 #define SCRIPT_FUNCTION_SIMPLIFY_CLOSURE(name) \
     ScriptValueP ScriptBuiltIn_##name::simplifyClosure(ScriptClosure& closure) const
 
+/// Macro to declare a new pure script function, whose results are remembered
+/** The result of the function may only depend on the values of the listed variables.
+ *  Usage:
+ *  @code
+ *   SCRIPT_FUNCTION_PURE(my_function, SCRIPT_VAR_input) {
+ *      // function code goes here
+ *   }
+ *  @endcode
+ */
+#define SCRIPT_FUNCTION_PURE(name, ...) \
+    class ScriptBuiltIn_##name : public ScriptValue { \
+      ScriptType type() const override \
+        { return SCRIPT_FUNCTION; } \
+      String typeName() const override \
+        { return _("built-in function '") _(#name) _("'"); } \
+      ScriptValueP eval(Context& ctx, bool) const override { \
+        static const Variable params[] = {__VA_ARGS__}; \
+        String key; \
+        if (!ScriptMemoTable::makeKey(ctx, params, sizeof(params) / sizeof(params[0]), key)) return evalPure(ctx); \
+        return memo.get(key, [&]{ return evalPure(ctx); }); \
+      } \
+      ScriptValueP evalPure(Context&) const; \
+      mutable ScriptMemoTable memo; \
+    }; \
+    ScriptValueP script_##name(new ScriptBuiltIn_##name); \
+    ScriptValueP ScriptBuiltIn_##name::evalPure(Context& ctx) const
+
 // helper for SCRIPT_FUNCTION and SCRIPT_FUNCTION_DEP
 #define SCRIPT_FUNCTION_AUX(name,dep) \
     class ScriptBuiltIn_##name : public ScriptValue { \
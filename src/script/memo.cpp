@@ -0,0 +1,126 @@
+//+----------------------------------------------------------------------------+
+//| Description:  Magic Set Editor - Program to make Magic (tm) cards          |
+//| Copyright:    (C) Twan van Laarhoven and the other MSE developers          |
+//| License:      GNU General Public License 2 or later (see file COPYING)     |
+//+----------------------------------------------------------------------------+
+
+// ----------------------------------------------------------------------------- : Includes
+
+#include <util/prec.hpp>
+#include <script/memo.hpp>
+#include <script/context.hpp>
+#include <script/to_value.hpp>
+#include <script/profiler.hpp>
+#include <typeinfo>
+
+// ----------------------------------------------------------------------------- : Keys
+
+/// Add a value to a memo key, returns false if the value can't be part of a key
+bool add_to_memo_key(String& key, const ScriptValueP& value) {
+  if (!value) {
+    key += _('u'); // not set
+    return true;
+  }
+  switch (value->type()) {
+    case SCRIPT_NIL:
+      key += _('n');
+      return true;
+    case SCRIPT_INT:
+      key += String::Format(_("i%d;"), value->toInt());
+      return true;
+    case SCRIPT_BOOL:
+      key += value->toBool() ? _('t') : _('f');
+      return true;
+    case SCRIPT_DOUBLE:
+      key += String::Format(_("d%.17g;"), value->toDouble());
+      return true;
+    case SCRIPT_STRING: {
+      // other string-like values (keyword parameters) convert differently than plain strings
+      static const std::type_info& plain_string = typeid(*to_script(String()));
+      if (typeid(*value) != plain_string) {
+        key += _('S') + value->typeName() + _(';');
+      }
+      String str = value->toString();
+      key += String::Format(_("s%u;"), (unsigned int)str.size());
+      key += str;
+      return true;
+    }
+    default:
+      return false; // collections, functions, images, etc. can't be compared cheaply
+  }
+}
+
+bool ScriptMemoTable::makeKey(Context& ctx, const Variable* vars, size_t count, String& key) {
+  for (size_t i = 0 ; i < count ; ++i) {
+    if (!add_to_memo_key(key, ctx.getVariableOpt(vars[i]))) return false;
+  }
+  return true;
+}
+
+bool ScriptMemoTable::makeKey(Context& ctx, String& key) {
+  vector<pair<Variable,ScriptValueP>> args;
+  ctx.getCallArguments(args);
+  // the order of arguments in the call doesn't matter
+  sort(args.begin(), args.end(), [](const pair<Variable,ScriptValueP>& a, const pair<Variable,ScriptValueP>& b) {
+    return a.first < b.first;
+  });
+  FOR_EACH_CONST(a, args) {
+    key += String::Format(_("%d="), (int)a.first);
+    if (!add_to_memo_key(key, a.second)) return false;
+  }
+  return true;
+}
+
+// ----------------------------------------------------------------------------- : ScriptMemoTable
+
+ScriptMemoTable::ScriptMemoTable(size_t capacity)
+  : capacity(capacity)
+{}
+
+bool ScriptMemoTable::lookup(const String& key, ScriptValueP& result) {
+  wxMutexLocker locker(lock);
+  auto it = index.find(key);
+  bool hit = it != index.end();
+  if (hit) {
+    entries.splice(entries.begin(), entries, it->second); // now most recently used
+    result = it->second->second;
+  }
+  #if USE_SCRIPT_PROFILING
+    Profiler::memoLookup(hit);
+  #endif
+  return hit;
+}
+
+void ScriptMemoTable::store(const String& key, const ScriptValueP& result) {
+  wxMutexLocker locker(lock);
+  if (index.find(key) != index.end()) return; // computed by another thread in the meantime
+  entries.push_front(make_pair(key, result));
+  index[key] = entries.begin();
+  if (entries.size() > capacity) {
+    index.erase(entries.back().first);
+    entries.pop_back();
+  }
+}
+
+void ScriptMemoTable::clear() {
+  wxMutexLocker locker(lock);
+  index.clear();
+  entries.clear();
+}
+
+// ----------------------------------------------------------------------------- : ScriptMemoized
+
+ScriptType ScriptMemoized::type() const { return SCRIPT_FUNCTION; }
+String ScriptMemoized::typeName() const { return _("memoized ") + fun->typeName(); }
+
+ScriptValueP ScriptMemoized::eval(Context& ctx, bool openScope) const {
+  String key;
+  if (!ScriptMemoTable::makeKey(ctx, key)) {
+    return fun->eval(ctx, openScope);
+  }
+  return memo.get(key, [&]{ return fun->eval(ctx, openScope); });
+}
+
+ScriptValueP ScriptMemoized::dependencies(Context& ctx, const Dependency& dep) const {
+  return fun->dependencies(ctx, dep);
+}
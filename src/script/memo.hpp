@@ -0,0 +1,76 @@
+//+----------------------------------------------------------------------------+
+//| Description:  Magic Set Editor - Program to make Magic (tm) cards          |
+//| Copyright:    (C) Twan van Laarhoven and the other MSE developers          |
+//| License:      GNU General Public License 2 or later (see file COPYING)     |
+//+----------------------------------------------------------------------------+
+
+#pragma once
+
+// ----------------------------------------------------------------------------- : Includes
+
+#include <util/prec.hpp>
+#include <script/script.hpp>
+#include <wx/thread.h>
+#include <list>
+
+class Context;
+
+// ----------------------------------------------------------------------------- : ScriptMemoTable
+
+/// A bounded table of remembered results of a pure function, keyed on the argument values
+/** When the table is full the least recently used result is forgotten.
+ *  Only simple arguments (nil, numbers, booleans and strings) can be part of a key,
+ *  calls with other arguments are not remembered.
+ *  The table can be used from multiple threads.
+ */
+class ScriptMemoTable {
+public:
+  ScriptMemoTable(size_t capacity = 1024);
+
+  /// Make a key from the values of the given variables, returns false if that is not possible
+  static bool makeKey(Context& ctx, const Variable* vars, size_t count, String& key);
+  /// Make a key from the parameters of the current call, returns false if that is not possible
+  static bool makeKey(Context& ctx, String& key);
+
+  /// Return the result for the given key, use compute() to determine it if it is not known
+  template <typename F>
+  ScriptValueP get(const String& key, F compute) {
+    ScriptValueP result;
+    if (lookup(key, result)) return result;
+    result = compute();
+    store(key, result);
+    return result;
+  }
+
+  /// Forget all results
+  void clear();
+
+private:
+  typedef std::list<pair<String,ScriptValueP>> Entries;
+  size_t capacity;
+  wxMutex lock;
+  Entries entries; ///< most recently used first
+  unordered_map<String,Entries::iterator> index;
+
+  bool lookup(const String& key, ScriptValueP& result);
+  void store(const String& key, const ScriptValueP& result);
+};
+
+// ----------------------------------------------------------------------------- : ScriptMemoized
+
+/// A user function whose results are remembered, see the memoize script function
+/** The function should only depend on its parameters, not on other variables like card or set.
+ */
+class ScriptMemoized : public ScriptValue {
+public:
+  inline ScriptMemoized(const ScriptValueP& fun) : fun(fun) {}
+
+  ScriptType type() const override;
+  String typeName() const override;
+  ScriptValueP eval(Context& ctx, bool openScope) const override;
+  ScriptValueP dependencies(Context& ctx, const Dependency& dep) const override;
+
+private:
+  ScriptValueP fun;
+  mutable ScriptMemoTable memo;
+};
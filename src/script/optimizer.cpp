@@ -0,0 +1,275 @@
+//+----------------------------------------------------------------------------+
+//| Description:  Magic Set Editor - Program to make Magic (tm) cards          |
+//| Copyright:    (C) Twan van Laarhoven and the other MSE developers          |
+//| License:      GNU General Public License 2 or later (see file COPYING)     |
+//+----------------------------------------------------------------------------+
+
+// ----------------------------------------------------------------------------- : Includes
+
+#include <util/prec.hpp>
+#include <util/error.hpp>
+#include <script/script.hpp>
+
+// from context.cpp
+void instrUnary  (UnaryInstructionType   i, ScriptValueP& a);
+void instrBinary (BinaryInstructionType  i, ScriptValueP& a, const ScriptValueP& b);
+
+bool optimize_scripts = true;
+
+// ----------------------------------------------------------------------------- : Utilities
+
+// The optimizer works on the instruction vector as produced by the parser.
+// Context::dependencies relies on the structure of that code:
+//  - conditional jumps must point forward,
+//  - the argument names after I_CALL/I_CLOSURE are not instructions,
+// the transformations below preserve these properties.
+
+/// Is the data of an instruction a jump target?
+inline bool is_jump(InstructionType t) {
+  return t == I_JUMP || t == I_JUMP_IF_NOT || t == I_JUMP_SC_AND || t == I_JUMP_SC_OR
+      || t == I_LOOP || t == I_LOOP_WITH_KEY;
+}
+
+/// Number of entries an instruction takes up in the instruction vector
+inline size_t instruction_size(const Instruction& i) {
+  return (i.instr == I_CALL || i.instr == I_CLOSURE || i.instr == I_TAILCALL) ? 1 + i.data : 1;
+}
+
+/// Is this a constant that can be computed with at parse time?
+/** Only simple values are allowed, other values may depend on the context they are used in */
+bool is_foldable(const ScriptValueP& v) {
+  ScriptType t = v->type();
+  return t == SCRIPT_NIL || t == SCRIPT_INT || t == SCRIPT_BOOL || t == SCRIPT_DOUBLE || t == SCRIPT_STRING;
+}
+
+/// For each position: is it the target of some jump?
+vector<bool> jump_targets(const vector<Instruction>& instrs) {
+  vector<bool> targets(instrs.size() + 1, false);
+  for (size_t p = 0 ; p < instrs.size() ; p += instruction_size(instrs[p])) {
+    if (is_jump(instrs[p].instr) && instrs[p].data <= instrs.size()) {
+      targets[instrs[p].data] = true;
+    }
+  }
+  return targets;
+}
+
+/// Remove the marked instructions, and update jump targets accordingly
+/** A jump to a removed instruction will go to the first instruction after it that is kept. */
+void remove_instructions(vector<Instruction>& instrs, const vector<bool>& removed) {
+  vector<unsigned int> new_pos(instrs.size() + 1);
+  unsigned int kept = 0;
+  for (size_t p = 0 ; p < instrs.size() ; ) {
+    // the argument names are kept or removed together with their instruction
+    size_t size = instruction_size(instrs[p]);
+    for (size_t k = 0 ; k < size && p + k < instrs.size() ; ++k) new_pos[p + k] = kept;
+    if (!removed[p]) kept += (unsigned int)size;
+    p += size;
+  }
+  new_pos[instrs.size()] = kept;
+  size_t out = 0;
+  for (size_t p = 0 ; p < instrs.size() ; ) {
+    size_t size = instruction_size(instrs[p]);
+    if (!removed[p]) {
+      Instruction i = instrs[p];
+      if (is_jump(i.instr)) i.data = new_pos[i.data];
+      instrs[out++] = i;
+      for (size_t k = 1 ; k < size ; ++k) instrs[out++] = instrs[p + k]; // argument names
+    }
+    p += size;
+  }
+  instrs.resize(out);
+}
+
+/// Add a constant to the constant table, return its index
+unsigned int add_constant(vector<ScriptValueP>& constants, const ScriptValueP& value) {
+  constants.push_back(value);
+  return (unsigned int)constants.size() - 1;
+}
+
+// ----------------------------------------------------------------------------- : Peephole
+
+/// Try to evaluate a unary instruction on a constant
+bool fold_unary(UnaryInstructionType op, ScriptValueP& a) {
+  if (op == I_ITERATOR_C || !is_foldable(a)) return false;
+  try {
+    instrUnary(op, a);
+    return true;
+  } catch (const Error&) {
+    return false; // leave the error for run time
+  }
+}
+
+/// Try to evaluate a binary instruction on two constants
+bool fold_binary(BinaryInstructionType op, ScriptValueP& a, const ScriptValueP& b) {
+  if (op == I_ITERATOR_R || op == I_MEMBER || op == I_OR_ELSE) return false;
+  if (!is_foldable(a) || !is_foldable(b)) return false;
+  try {
+    if ((op == I_DIV || op == I_MOD) && b->toDouble() == 0) return false;
+    instrBinary(op, a, b);
+    return true;
+  } catch (const Error&) {
+    return false; // leave the error for run time
+  }
+}
+
+/// Evaluate a constant condition, return false if that is not possible
+bool constant_condition(const ScriptValueP& c, bool& value) {
+  if (!is_foldable(c)) return false;
+  try {
+    value = c->toBool();
+    return true;
+  } catch (const Error&) {
+    return false;
+  }
+}
+
+/// Peephole optimizations of short instruction sequences
+/** Sequences are only combined if no jump goes into the middle of them.
+ *  Returns true if something has changed.
+ */
+bool optimize_peephole(vector<Instruction>& instrs, vector<ScriptValueP>& constants) {
+  vector<bool> targets = jump_targets(instrs);
+  vector<bool> removed(instrs.size(), false);
+  bool changed = false;
+  size_t p = 0;
+  while (p < instrs.size()) {
+    Instruction& a = instrs[p];
+    size_t q = p + instruction_size(a);
+    if (q >= instrs.size() || targets[q]) {
+      p = q;
+      continue;
+    }
+    Instruction& b = instrs[q];
+    size_t r = q + instruction_size(b);
+    bool three = r < instrs.size() && !targets[r];
+    size_t next = q;
+    if ((a.instr == I_PUSH_CONST || a.instr == I_DUP) && b.instr == I_POP) {
+      // push x; pop  -->  nothing
+      removed[p] = removed[q] = true;
+      next = r;
+    } else if (a.instr == I_PUSH_CONST && b.instr == I_UNARY) {
+      // push x; unary op  -->  push (op x)
+      ScriptValueP v = constants[a.data];
+      if (fold_unary(b.instr1, v)) {
+        a.data = add_constant(constants, v);
+        removed[q] = true;
+        next = r;
+      }
+    } else if (a.instr == I_PUSH_CONST && b.instr == I_PUSH_CONST && three && instrs[r].instr == I_BINARY) {
+      // push x; push y; binary op  -->  push (x op y)
+      ScriptValueP v = constants[a.data];
+      if (fold_binary(instrs[r].instr2, v, constants[b.data])) {
+        a.data = add_constant(constants, v);
+        removed[q] = removed[r] = true;
+        next = r + 1;
+      }
+    } else if (a.instr == I_PUSH_CONST && b.instr == I_BINARY && b.instr2 == I_MEMBER && is_foldable(constants[a.data])) {
+      // push x; member  -->  member_c x
+      a.instr = I_MEMBER_C;
+      removed[q] = true;
+      next = r;
+    } else if (a.instr == I_PUSH_CONST && b.instr == I_JUMP_IF_NOT) {
+      // push true;  jump_if_not l  -->  nothing
+      // push false; jump_if_not l  -->  jump l
+      bool cond;
+      if (constant_condition(constants[a.data], cond)) {
+        if (cond) {
+          removed[p] = true;
+        } else {
+          a.instr = I_JUMP;
+          a.data  = b.data;
+        }
+        removed[q] = true;
+        next = r;
+      }
+    } else if (a.instr == I_PUSH_CONST && (b.instr == I_JUMP_SC_AND || b.instr == I_JUMP_SC_OR)) {
+      // push x; jump_sc_and l  -->  push x; jump l   if x is false
+      //                        -->  nothing          if x is true
+      bool cond;
+      if (constant_condition(constants[a.data], cond)) {
+        if (cond == (b.instr == I_JUMP_SC_OR)) {
+          b.instr = I_JUMP;
+        } else {
+          removed[p] = removed[q] = true;
+        }
+        next = r;
+      }
+    }
+    if (next != q) changed = true;
+    p = next;
+  }
+  if (changed) remove_instructions(instrs, removed);
+  return changed;
+}
+
+// ----------------------------------------------------------------------------- : Jumps
+
+/// Let jumps to unconditional jumps go to the final target directly, remove jumps to the next instruction
+/** Only forward jumps are threaded, backward jumps are what Context::dependencies uses to detect loops.
+ *  Returns true if something has changed.
+ */
+bool optimize_jumps(vector<Instruction>& instrs) {
+  vector<bool> removed(instrs.size(), false);
+  bool changed = false, any_removed = false;
+  for (size_t p = 0 ; p < instrs.size() ; p += instruction_size(instrs[p])) {
+    Instruction& i = instrs[p];
+    if (i.instr != I_JUMP && i.instr != I_JUMP_IF_NOT && i.instr != I_JUMP_SC_AND && i.instr != I_JUMP_SC_OR) continue;
+    if (i.data <= p) continue;
+    // jump to jump
+    while (i.data < instrs.size() && instrs[i.data].instr == I_JUMP && instrs[i.data].data > i.data) {
+      i.data = instrs[i.data].data;
+      changed = true;
+    }
+    // jump to next instruction
+    if (i.instr == I_JUMP && i.data == p + 1) {
+      removed[p] = true;
+      changed = any_removed = true;
+    }
+  }
+  if (any_removed) remove_instructions(instrs, removed);
+  return changed;
+}
+
+/// Remove instructions that can not be reached from the start of the script
+/** Returns true if something has changed. */
+bool remove_unreachable(vector<Instruction>& instrs) {
+  vector<bool> reached(instrs.size() + 1, false);
+  vector<size_t> todo(1, 0);
+  while (!todo.empty()) {
+    size_t p = todo.back(); todo.pop_back();
+    while (p < instrs.size() && !reached[p]) {
+      reached[p] = true;
+      const Instruction& i = instrs[p];
+      if (is_jump(i.instr) && i.data < instrs.size()) {
+        todo.push_back(i.data);
+      }
+      if (i.instr == I_JUMP) break;
+      p += instruction_size(i);
+    }
+  }
+  vector<bool> removed(instrs.size(), false);
+  bool changed = false;
+  for (size_t p = 0 ; p < instrs.size() ; p += instruction_size(instrs[p])) {
+    if (!reached[p]) removed[p] = changed = true;
+  }
+  if (changed) remove_instructions(instrs, removed);
+  return changed;
+}
+
+// ----------------------------------------------------------------------------- : Script::optimize
+
+void Script::optimize() {
+  if (!optimize_scripts) return;
+  // functions defined in this script
+  FOR_EACH(c, constants) {
+    if (Script* s = dynamic_cast<Script*>(c.get())) s->optimize();
+  }
+  // optimize until nothing changes, each step makes the code smaller or moves jumps forward
+  bool changed = true;
+  while (changed) {
+    changed  = optimize_peephole(instructions, constants);
+    changed |= optimize_jumps(instructions);
+    changed |= remove_unreachable(instructions);
+  }
+  member_hints.resize(constants.size());
+}
@@ -416,6 +416,7 @@ ScriptP parse(const String& s, Packaged* package, bool string_mode, vector<Scrip
   if (type == EXPR_FAILED) {
     return ScriptP();
   } else {
+    if (errors_out.empty()) script->optimize();
     return script;
   }
 }
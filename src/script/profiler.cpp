@@ -61,8 +61,10 @@ void profile_aggregate(FunctionProfile& parent, int level, int max_level, size_t
   if (!fpp) {
     fpp = make_intrusive<FunctionProfile>(p.name);
   }
-  fpp->time_ticks += p.time_ticks;
-  fpp->calls      += p.calls;
+  fpp->time_ticks  += p.time_ticks;
+  fpp->calls       += p.calls;
+  fpp->memo_hits   += p.memo_hits;
+  fpp->memo_misses += p.memo_misses;
   // recurse
   if (level == 0) {
     profile_aggregate(parent, level, max_level, p);
@@ -138,5 +140,10 @@ Profiler::~Profiler() {
   function = parent; // pop
 }
 
+void Profiler::memoLookup(bool hit) {
+  if (hit) function->memo_hits   += 1;
+  else     function->memo_misses += 1;
+}
+
 // ----------------------------------------------------------------------------- : EOF
 #endif
@@ -75,13 +75,15 @@ private:
 class FunctionProfile : public IntrusivePtrBase<FunctionProfile> {
 public:
   FunctionProfile(const String& name)
-    : name(name), time_ticks(0), time_ticks_max(0), calls(0)
+    : name(name), time_ticks(0), time_ticks_max(0), calls(0), memo_hits(0), memo_misses(0)
   {}
 
   String      name;
   ProfileTime time_ticks;
   ProfileTime time_ticks_max;
   int         calls;
+  int         memo_hits;   ///< Number of calls that used a remembered result of a pure function
+  int         memo_misses; ///< Number of calls to a pure function that had to be evaluated
   
   /// for each id, called children
   /** we (ab)use the fact that all pointers are even to store both pointers and ids */
@@ -118,6 +120,8 @@ public:
   Profiler(Timer& timer, void* function_object, const String& function_name);
   /// Log the fact that the function is left
   ~Profiler();
+  /// Count a lookup in a ScriptMemoTable for the function we are in
+  static void memoLookup(bool hit);
 private:
   Timer&                  timer;
   static FunctionProfile* function; ///< function we are in
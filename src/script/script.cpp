@@ -126,11 +126,13 @@ void Script::addInstruction(InstructionType t, Addr d) {
 }
 void Script::addInstruction(InstructionType t, const ScriptValueP& c) {
   constants.push_back(c);
+  member_hints.resize(constants.size());
   Instruction i = {t, {(unsigned int)constants.size() - 1}};
   instructions.push_back(i);
 }
 void Script::addInstruction(InstructionType t, const String& s) {
   constants.push_back(to_script(s));
+  member_hints.resize(constants.size());
   Instruction i = {t, {(unsigned int)constants.size() - 1}};
   instructions.push_back(i);
 }
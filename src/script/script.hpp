@@ -160,6 +160,9 @@ String variable_to_string(Variable v);
 /// initialze the script variables
 void init_script_variables();
 
+/// Should parsed scripts be optimized? (default: true)
+extern bool optimize_scripts;
+
 
 // ----------------------------------------------------------------------------- : Script
 
@@ -198,6 +201,12 @@ public:
   /// Get access to the vector of constants
   inline vector<ScriptValueP>& getConstants()   { return constants; }
   
+  /// Optimize the instructions of this script and of the functions defined in it
+  /** Folds constant expressions, threads jumps, combines common instruction pairs
+   *  and removes unreachable code. Does nothing if optimize_scripts is false.
+   */
+  void optimize();
+  
   /// Output the instructions in a human readable format
   String dumpScript() const;
   /// Output an instruction in a human readable format
@@ -210,6 +219,8 @@ private:
   vector<Instruction>  instructions;
   /// Constant values that can be referred to from the script
   vector<ScriptValueP> constants;
+  /// Hints for member lookups by I_MEMBER_C, one for each constant
+  mutable vector<IndexHint> member_hints;
   
   /// Do a backtrace for error messages.
   /** Starting from instr, move backwards until the nett stack effect
@@ -221,5 +232,6 @@ private:
   String instructionName(const Instruction* instr) const;
   
   friend class Context;
+  friend class ScriptCache;
 };
 
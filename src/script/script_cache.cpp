@@ -0,0 +1,337 @@
+//+----------------------------------------------------------------------------+
+//| Description:  Magic Set Editor - Program to make Magic (tm) cards          |
+//| Copyright:    (C) Twan van Laarhoven and the other MSE developers          |
+//| License:      GNU General Public License 2 or later (see file COPYING)     |
+//+----------------------------------------------------------------------------+
+
+// ----------------------------------------------------------------------------- : Includes
+
+#include <util/prec.hpp>
+#include <script/script_cache.hpp>
+#include <script/to_value.hpp>
+#include <util/version.hpp>
+#include <wx/file.h>
+#include <wx/filename.h>
+#include <typeinfo>
+
+IMPLEMENT_DYNAMIC_ARG(ScriptCache*, script_cache, nullptr);
+
+extern ScriptValueP script_warning;
+extern ScriptValueP script_warning_if_neq;
+String user_settings_dir();
+
+// ----------------------------------------------------------------------------- : Binary format
+
+/// Version of the cache file format, increment when the format or the meaning of instructions changes
+const UInt SCRIPT_CACHE_FORMAT = 1;
+/// Don't read cache files larger than this
+const wxFileOffset SCRIPT_CACHE_MAX_SIZE = 64 * 1024 * 1024;
+
+/// Types of constants in a compiled script
+enum CacheConstant
+{  CACHE_NIL
+,  CACHE_TRUE
+,  CACHE_FALSE
+,  CACHE_INT
+,  CACHE_DOUBLE
+,  CACHE_STRING
+,  CACHE_SCRIPT
+,  CACHE_WARNING
+,  CACHE_WARNING_IF_NEQ
+};
+
+// All numbers are little endian
+
+inline void write_u8(vector<Byte>& out, UInt x) {
+  out.push_back(Byte(x));
+}
+inline void write_u32(vector<Byte>& out, UInt x) {
+  for (int i = 0 ; i < 4 ; ++i) out.push_back(Byte(x >> (8 * i)));
+}
+inline void write_u64(vector<Byte>& out, unsigned long long x) {
+  for (int i = 0 ; i < 8 ; ++i) out.push_back(Byte(x >> (8 * i)));
+}
+void write_string(vector<Byte>& out, const String& str) {
+  wxCharBuffer utf8 = str.utf8_str();
+  size_t size = strlen(utf8.data());
+  write_u32(out, (UInt)size);
+  out.insert(out.end(), utf8.data(), utf8.data() + size);
+}
+
+/// Reads from a buffer, after an error (reading past the end) everything reads as 0
+class CacheReader {
+public:
+  CacheReader(const Byte* pos, const Byte* end) : ok(true), pos(pos), end(end) {}
+
+  bool ok;
+
+  inline size_t remaining() const { return end - pos; }
+
+  const Byte* bytes(size_t size) {
+    if (!ok || remaining() < size) {
+      ok = false;
+      return nullptr;
+    }
+    const Byte* data = pos;
+    pos += size;
+    return data;
+  }
+  UInt u8() {
+    const Byte* p = bytes(1);
+    return p ? p[0] : 0;
+  }
+  UInt u32() {
+    const Byte* p = bytes(4);
+    return p ? p[0] | p[1] << 8 | p[2] << 16 | (UInt)p[3] << 24 : 0;
+  }
+  unsigned long long u64() {
+    unsigned long long low = u32();
+    return low | (unsigned long long)u32() << 32;
+  }
+  String string() {
+    size_t size = u32();
+    const Byte* p = bytes(size);
+    return p ? String::FromUTF8((const char*)p, size) : String();
+  }
+
+private:
+  const Byte* pos;
+  const Byte* end;
+};
+
+/// Does the instruction have a variable as its data?
+inline bool has_variable(const Instruction& i) {
+  return i.instr == I_GET_VAR || i.instr == I_SET_VAR;
+}
+/// Is the instruction followed by argument names?
+inline bool has_arguments(const Instruction& i) {
+  return i.instr == I_CALL || i.instr == I_CLOSURE || i.instr == I_TAILCALL;
+}
+
+bool ScriptCache::writeScript(vector<Byte>& out, const Script& script) {
+  // instructions, variable numbers are different in each run of the program, so store their names
+  write_u32(out, (UInt)script.instructions.size());
+  size_t arguments = 0;
+  FOR_EACH_CONST(i, script.instructions) {
+    write_u8(out, i.instr);
+    if (arguments > 0 || has_variable(i)) {
+      write_string(out, variable_to_string((Variable)i.data));
+      if (arguments > 0) --arguments;
+    } else {
+      write_u32(out, i.data);
+      if (has_arguments(i)) arguments = i.data;
+    }
+  }
+  // constants
+  static const std::type_info& plain_string = typeid(*to_script(String()));
+  write_u32(out, (UInt)script.constants.size());
+  FOR_EACH_CONST(c, script.constants) {
+    switch (c->type()) {
+      case SCRIPT_NIL:
+        write_u8(out, CACHE_NIL);
+        break;
+      case SCRIPT_BOOL:
+        write_u8(out, c->toBool() ? CACHE_TRUE : CACHE_FALSE);
+        break;
+      case SCRIPT_INT:
+        write_u8(out, CACHE_INT);
+        write_u32(out, (UInt)c->toInt());
+        break;
+      case SCRIPT_DOUBLE: {
+        double d = c->toDouble();
+        unsigned long long bits;
+        memcpy(&bits, &d, sizeof(bits));
+        write_u8(out, CACHE_DOUBLE);
+        write_u64(out, bits);
+        break;
+      }
+      case SCRIPT_STRING:
+        if (typeid(*c) != plain_string) return false;
+        write_u8(out, CACHE_STRING);
+        write_string(out, c->toString());
+        break;
+      case SCRIPT_FUNCTION:
+        if (c == script_warning) {
+          write_u8(out, CACHE_WARNING);
+        } else if (c == script_warning_if_neq) {
+          write_u8(out, CACHE_WARNING_IF_NEQ);
+        } else if (const Script* s = dynamic_cast<const Script*>(c.get())) {
+          write_u8(out, CACHE_SCRIPT);
+          if (!writeScript(out, *s)) return false;
+        } else {
+          return false;
+        }
+        break;
+      default:
+        return false; // not a value the parser makes
+    }
+  }
+  return true;
+}
+
+ScriptP ScriptCache::readScript(CacheReader& in) {
+  ScriptP script = make_intrusive<Script>();
+  // instructions
+  size_t count = in.u32();
+  if (count > in.remaining()) return ScriptP();
+  script->instructions.reserve(count);
+  size_t arguments = 0;
+  for (size_t n = 0 ; n < count && in.ok ; ++n) {
+    Instruction i;
+    i.instr = (InstructionType)in.u8();
+    if (arguments > 0 || has_variable(i)) {
+      i.data = (unsigned int)string_to_variable(in.string());
+      if (arguments > 0) --arguments;
+    } else {
+      i.data = in.u32();
+      if (has_arguments(i)) arguments = i.data;
+    }
+    script->instructions.push_back(i);
+  }
+  // constants
+  count = in.u32();
+  if (count > in.remaining()) return ScriptP();
+  script->constants.reserve(count);
+  for (size_t n = 0 ; n < count && in.ok ; ++n) {
+    switch (in.u8()) {
+      case CACHE_NIL:   script->constants.push_back(script_nil);   break;
+      case CACHE_TRUE:  script->constants.push_back(script_true);  break;
+      case CACHE_FALSE: script->constants.push_back(script_false); break;
+      case CACHE_INT:   script->constants.push_back(to_script((int)in.u32())); break;
+      case CACHE_DOUBLE: {
+        unsigned long long bits = in.u64();
+        double d;
+        memcpy(&d, &bits, sizeof(d));
+        script->constants.push_back(to_script(d));
+        break;
+      }
+      case CACHE_STRING:  script->constants.push_back(to_script(in.string())); break;
+      case CACHE_WARNING: script->constants.push_back(script_warning); break;
+      case CACHE_WARNING_IF_NEQ: script->constants.push_back(script_warning_if_neq); break;
+      case CACHE_SCRIPT: {
+        ScriptP sub = readScript(in);
+        if (!sub) return ScriptP();
+        script->constants.push_back(sub);
+        break;
+      }
+      default:
+        return ScriptP();
+    }
+  }
+  if (!in.ok) return ScriptP();
+  // a damaged file should not make us crash
+  size_t size = script->instructions.size();
+  FOR_EACH_CONST(i, script->instructions) {
+    if ((i.instr == I_PUSH_CONST || i.instr == I_MEMBER_C) && i.data >= script->constants.size()) return ScriptP();
+    if ((i.instr == I_JUMP || i.instr == I_JUMP_IF_NOT || i.instr == I_JUMP_SC_AND || i.instr == I_JUMP_SC_OR
+      || i.instr == I_LOOP || i.instr == I_LOOP_WITH_KEY) && i.data > size) return ScriptP();
+  }
+  script->member_hints.resize(script->constants.size());
+  return script;
+}
+
+// ----------------------------------------------------------------------------- : ScriptCache
+
+/// A hash of a string, that is the same in each run of the program (FNV-1a)
+UInt stable_hash(const String& str) {
+  UInt hash = 2166136261u;
+  FOR_EACH_CONST(c, str) {
+    hash = (hash ^ (UInt)c) * 16777619u;
+  }
+  return hash;
+}
+
+ScriptCache::ScriptCache(const String& package_filename, const wxDateTime& package_modified)
+  : changed(false)
+{
+  String dir = user_settings_dir() + _("cache");
+  if (!wxDirExists(dir)) wxMkdir(dir);
+  filename = dir + _("/") + wxFileName(package_filename).GetFullName()
+           + String::Format(_("-%08x.mse-script-cache"), stable_hash(package_filename));
+  header = String::Format(_("MSE script cache %u, %s, optimize %d\n"), SCRIPT_CACHE_FORMAT, app_version.toString(), (int)optimize_scripts)
+         + package_filename + _("\n")
+         + package_modified.GetValue().ToString();
+  load();
+}
+
+void ScriptCache::load() {
+  if (!wxFileExists(filename)) return;
+  wxFile file(filename);
+  if (!file.IsOpened() || file.Length() > SCRIPT_CACHE_MAX_SIZE) return;
+  vector<Byte> data((size_t)file.Length());
+  if (file.Read(data.data(), data.size()) != (ssize_t)data.size()) return;
+  CacheReader in(data.data(), data.data() + data.size());
+  if (in.string() != header) return; // out of date
+  size_t count = in.u32();
+  for (size_t n = 0 ; n < count && in.ok ; ++n) {
+    String key = in.string();
+    size_t size = in.u32();
+    const Byte* bytes = in.bytes(size);
+    if (!bytes) break;
+    Entry& entry = entries[key];
+    entry.data.assign(bytes, bytes + size);
+    entry.used = false;
+  }
+  if (!in.ok) entries.clear();
+}
+
+ScriptP ScriptCache::find(const String& code, bool string_mode) {
+  String key = (string_mode ? _("s") : _("e")) + code;
+  auto it = entries.find(key);
+  if (it == entries.end()) return ScriptP();
+  CacheReader in(it->second.data.data(), it->second.data.data() + it->second.data.size());
+  ScriptP script = readScript(in);
+  if (script) {
+    it->second.used = true;
+  } else {
+    entries.erase(it);
+    changed = true;
+  }
+  return script;
+}
+
+/// Can a script include other files?
+/** Both the "include file: x" directive and the include_file("x") form it is turned into are checked */
+bool includes_files(const String& code) {
+  return code.find(_("include file:")) != String::npos
+      || code.find(_("include_file"))  != String::npos;
+}
+
+void ScriptCache::add(const String& code, bool string_mode, const Script& script) {
+  if (includes_files(code)) return; // depends on another file
+  Entry entry;
+  if (!writeScript(entry.data, script)) return;
+  entry.used = true;
+  entries[(string_mode ? _("s") : _("e")) + code] = std::move(entry);
+  changed = true;
+}
+
+void ScriptCache::save() {
+  if (!changed) return;
+  vector<Byte> out;
+  write_string(out, header);
+  UInt count = 0;
+  FOR_EACH_CONST(e, entries) {
+    if (e.second.used) ++count;
+  }
+  write_u32(out, count);
+  FOR_EACH_CONST(e, entries) {
+    if (!e.second.used) continue;
+    write_string(out, e.first);
+    write_u32(out, (UInt)e.second.data.size());
+    out.insert(out.end(), e.second.data.begin(), e.second.data.end());
+  }
+  // write to a temporary file first, another instance of the program could be reading the cache
+  String temp_name = filename + _(".tmp");
+  {
+    wxFile file;
+    if (!file.Create(temp_name, true)) return;
+    if (file.Write(out.data(), out.size()) != out.size()) {
+      file.Close();
+      wxRemoveFile(temp_name);
+      return;
+    }
+  }
+  wxRenameFile(temp_name, filename, true);
+  changed = false;
+}
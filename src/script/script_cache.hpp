@@ -0,0 +1,59 @@
+//+----------------------------------------------------------------------------+
+//| Description:  Magic Set Editor - Program to make Magic (tm) cards          |
+//| Copyright:    (C) Twan van Laarhoven and the other MSE developers          |
+//| License:      GNU General Public License 2 or later (see file COPYING)     |
+//+----------------------------------------------------------------------------+
+
+#pragma once
+
+// ----------------------------------------------------------------------------- : Includes
+
+#include <util/prec.hpp>
+#include <util/dynamic_arg.hpp>
+#include <script/script.hpp>
+
+class ScriptCache;
+class CacheReader;
+
+/// The cache of compiled scripts for the package that is currently being read, if any
+DECLARE_DYNAMIC_ARG(ScriptCache*, script_cache);
+
+// ----------------------------------------------------------------------------- : ScriptCache
+
+/// Compiled scripts of a package, stored on disk so they don't have to be parsed again
+/** The cache is a file in the user's cache directory, it is only used if the package has not
+ *  been modified since the cache was written, and if it was written by the same version of the program.
+ *
+ *  Scripts are looked up by their source code. Scripts with parse errors or warnings are not cached,
+ *  so those are reported every time. Neither are scripts that include other files,
+ *  since the cache can't tell when those change.
+ */
+class ScriptCache {
+public:
+  /// Load the cache for a package, if it is up to date
+  ScriptCache(const String& package_filename, const wxDateTime& package_modified);
+
+  /// Find a compiled script, returns nullptr if it is not in the cache
+  ScriptP find(const String& code, bool string_mode);
+  /// Add a script that was just compiled
+  void add(const String& code, bool string_mode, const Script& script);
+
+  /// Write the cache to disk if something was added
+  /** Only scripts that were used since loading are written, so unused ones are dropped */
+  void save();
+
+private:
+  struct Entry {
+    vector<Byte> data; ///< The serialized script
+    bool used;
+  };
+  String filename;
+  String header; ///< Identifies the package and program, the cache is only valid if this matches
+  unordered_map<String,Entry> entries; ///< by string_mode + code
+  bool changed;
+
+  void load();
+  /// Serialize a script, returns false if it contains values that can't be stored
+  static bool writeScript(vector<Byte>& out, const Script& script);
+  static ScriptP readScript(CacheReader& in);
+};
@@ -19,6 +19,7 @@
 #include <data/action/set.hpp>
 #include <data/action/value.hpp>
 #include <data/action/keyword.hpp>
+#include <data/settings.hpp>
 #include <util/error.hpp>
 
 // ----------------------------------------------------------------------------- : SetScriptContext : initialization
@@ -111,6 +112,65 @@ void SetScriptManager::initDependencies(Context& ctx, Game& game) {
   FOR_EACH(f, game.set_fields) {
     f->initDependencies(ctx, Dependency(DEP_SET_FIELD, f->index));
   }
+  initUpdateOrder(game);
+}
+
+void SetScriptManager::initUpdateOrder(Game& game) {
+  // The nodes of the dependency graph are the set fields followed by the card fields,
+  // there is an edge from a field to each field with a script that depends on it.
+  // Stylesheet dependencies (styles, extra fields) are not values, so they don't affect the order.
+  size_t set_count = game.set_fields.size();
+  size_t count = set_count + game.card_fields.size();
+  auto field_at = [&](size_t node) -> Field& {
+    return node < set_count ? *game.set_fields[node] : *game.card_fields[node - set_count];
+  };
+  vector<vector<size_t>> edges(count);
+  vector<int> in_degree(count, 0);
+  for (size_t node = 0 ; node < count ; ++node) {
+    // follow copied dependencies, but don't loop
+    vector<const Dependencies*> todo(1, &field_at(node).dependent_scripts);
+    std::set<size_t> copied;
+    while (!todo.empty()) {
+      const Dependencies* deps = todo.back(); todo.pop_back();
+      FOR_EACH_CONST(d, *deps) {
+        size_t target;
+        if (d.type == DEP_SET_FIELD) {
+          target = d.index;
+        } else if (d.type == DEP_CARD_FIELD || d.type == DEP_CARDS_FIELD) {
+          target = set_count + d.index;
+        } else if (d.type == DEP_SET_COPY_DEP || d.type == DEP_CARD_COPY_DEP) {
+          size_t from = d.type == DEP_SET_COPY_DEP ? d.index : set_count + d.index;
+          if (copied.insert(from).second) todo.push_back(&field_at(from).dependent_scripts);
+          continue;
+        } else {
+          continue;
+        }
+        if (target >= count || find(edges[node].begin(), edges[node].end(), target) != edges[node].end()) continue;
+        edges[node].push_back(target);
+        in_degree[target]++;
+      }
+    }
+  }
+  // topological sort
+  deque<size_t> ready;
+  for (size_t node = 0 ; node < count ; ++node) {
+    if (in_degree[node] == 0) ready.push_back(node);
+  }
+  int order = 0;
+  vector<bool> done(count, false);
+  while (!ready.empty()) {
+    size_t node = ready.front(); ready.pop_front();
+    field_at(node).update_order = order++;
+    done[node] = true;
+    FOR_EACH_CONST(target, edges[node]) {
+      if (--in_degree[target] == 0) ready.push_back(target);
+    }
+  }
+  // fields on a cycle come last, in the order they are declared;
+  // the age check in updateToUpdate prevents those from being updated forever
+  for (size_t node = 0 ; node < count ; ++node) {
+    if (!done[node]) field_at(node).update_order = order++;
+  }
 }
 
 
@@ -180,6 +240,7 @@ void SetScriptManager::onAction(const Action& action, bool undone) {
     // note: fallthrough
   }
   TYPE_CASE_(action, CardListAction) {
+    set.clearOrderCache();
     #ifdef LOG_UPDATES
       wxLogDebug(_("Card dependencies"));
     #endif
@@ -189,17 +250,21 @@ void SetScriptManager::onAction(const Action& action, bool undone) {
     #endif
   }
   TYPE_CASE_(action, KeywordListAction) {
+    set.clearOrderCache();
     updateAllDependend(set.game->dependent_scripts_keywords);
     return;
   }
   TYPE_CASE_(action, ChangeKeywordModeAction) {
+    set.clearOrderCache();
     updateAllDependend(set.game->dependent_scripts_keywords);
     return;
   }
   TYPE_CASE(action, ChangeCardStyleAction) {
+    set.clearOrderCache(action.card);
     updateAllDependend(set.game->dependent_scripts_stylesheet, action.card);
   }
   TYPE_CASE_(action, ChangeSetStyleAction) {
+    set.clearOrderCache();
     updateAllDependend(set.game->dependent_scripts_stylesheet);
     return;
   }
@@ -214,6 +279,7 @@ void SetScriptManager::updateStyles(const CardP& card, bool only_content_depende
     IndexMap<FieldP,ValueP>& extra_data = card->extraDataFor(stylesheet);
     FOR_EACH(v, extra_data) {
       if (v->update(ctx)) {
+        valueChanged(card);
         // changed, send event
         ScriptValueEvent change(card.get(), v.get());
         set.actions.tellListeners(change, false);
@@ -241,6 +307,7 @@ void SetScriptManager::updateStyles(Context& ctx, const IndexMap<FieldP,StyleP>&
 
 void SetScriptManager::updateDelayed() {
   if (delay & DELAY_KEYWORDS) {
+    set.clearOrderCache();
     updateAllDependend(set.game->dependent_scripts_keywords);
   }
   delay = 0;
@@ -248,9 +315,10 @@ void SetScriptManager::updateDelayed() {
 
 void SetScriptManager::updateValue(Value& value, const CardP& card) {
   Age starting_age; // the start of the update process
-  deque<ToUpdate> to_update;
+  UpdateQueue to_update;
   // execute script for initial changed value
   value.update(getContext(card));
+  valueChanged(card);
   #ifdef LOG_UPDATES
     wxLogDebug(_("Start:     %s"), value.fieldP->name);
   #endif
@@ -262,6 +330,9 @@ void SetScriptManager::updateValue(Value& value, const CardP& card) {
   #endif
 }
 
+/// With fewer cards per thread, starting the threads costs more than it gains
+const size_t MIN_CARDS_PER_UPDATE_THREAD = 32;
+
 void SetScriptManager::updateAll() {
   #ifdef LOG_UPDATES
     wxLogDebug(_("Update all"));
@@ -278,44 +349,148 @@ void SetScriptManager::updateAll() {
     }
   }
   // update card data of all cards
-  FOR_EACH(card, set.cards) {
-    Context& ctx = getContext(card);
-    FOR_EACH(v, card->data) {
-      try {
-        #if USE_SCRIPT_PROFILING
-          Timer t;
-          Profiler prof(t, v->fieldP.get(), _("update card.") + v->fieldP->name);
-        #endif
-        v->update(ctx);
-      } catch (const ScriptError& e) {
-        handle_error(ScriptError(e.what() + _("\n  while updating card value '") + v->fieldP->name + _("'")));
+  int thread_count = settings.script_update_threads > 0 ? settings.script_update_threads : wxThread::GetCPUCount();
+  thread_count = min(thread_count, (int)(set.cards.size() / MIN_CARDS_PER_UPDATE_THREAD));
+  if (thread_count > 1) {
+    updateAllCardsInParallel(thread_count);
+  } else {
+    FOR_EACH(card, set.cards) {
+      Context& ctx = getContext(card);
+      FOR_EACH(v, card->data) {
+        try {
+          #if USE_SCRIPT_PROFILING
+            Timer t;
+            Profiler prof(t, v->fieldP.get(), _("update card.") + v->fieldP->name);
+          #endif
+          v->update(ctx);
+        } catch (const ScriptError& e) {
+          handle_error(ScriptError(e.what() + _("\n  while updating card value '") + v->fieldP->name + _("'")));
+        }
       }
     }
   }
   // update things that depend on the card list
+  set.clearOrderCache(); // all card values were updated, possibly by other threads
   updateAllDependend(set.game->dependent_scripts_cards);
   #ifdef LOG_UPDATES
     wxLogDebug(_("-------------------------------\n"));
   #endif
 }
 
+// ----------------------------------------------------------------------------- : ScriptManager : parallel updating
+
+/// Thread that updates the fields of a range of cards
+/** Each thread has its own contexts, initialized with the init scripts of the game and stylesheets.
+ *  Fields that depend on other cards are skipped, the main thread updates those afterwards.
+ */
+class CardUpdateThread : public wxThread {
+public:
+  CardUpdateThread(Set& set, size_t begin, size_t end, const vector<bool>& skip)
+    : wxThread(wxTHREAD_JOINABLE)
+    , set(set), begin(begin), end(end), skip(skip)
+  {}
+  
+  vector<String> errors; ///< Errors from the scripts, reported by the main thread afterwards
+  
+  /// Update the values of the cards, on the current thread
+  void update() {
+    SetScriptContext scripts(set);
+    for (size_t i = begin ; i < end ; ++i) {
+      const CardP& card = set.cards[i];
+      Context& ctx = scripts.getContext(card);
+      FOR_EACH(v, card->data) {
+        if (v->fieldP->index < skip.size() && skip[v->fieldP->index]) continue;
+        try {
+          v->update(ctx);
+        } catch (const Error& e) {
+          errors.push_back(e.what() + _("\n  while updating card value '") + v->fieldP->name + _("'"));
+        } catch (const std::exception& e) {
+          // exceptions can't leave the thread
+          errors.push_back(String(e.what(), IF_UNICODE(wxConvLocal, wxSTRING_MAXLEN)) + _("\n  while updating card value '") + v->fieldP->name + _("'"));
+        } catch (...) {
+          errors.push_back(_("An unexpected exception occurred!\n  while updating card value '") + v->fieldP->name + _("'"));
+        }
+      }
+    }
+  }
+  
+protected:
+  ExitCode Entry() override {
+    update();
+    return 0;
+  }
+  
+private:
+  Set& set;
+  size_t begin, end;
+  const vector<bool>& skip;
+};
+
+void SetScriptManager::updateAllCardsInParallel(int thread_count) {
+  // fields that depend on the card list can read other cards while they are being updated,
+  // updateAll updates them afterwards with updateAllDependend
+  vector<bool> skip(set.game->card_fields.size(), false);
+  FOR_EACH_CONST(d, set.game->dependent_scripts_cards) {
+    if ((d.type == DEP_CARD_FIELD || d.type == DEP_CARDS_FIELD) && d.index < skip.size()) {
+      skip[d.index] = true;
+    }
+  }
+  // things that are initialized on first use should be initialized now, so the threads only read them
+  set.keywordDatabase();
+  FOR_EACH(card, set.cards) {
+    set.stylingDataFor(set.stylesheetFor(card));
+    set.stylingDataFor(card);
+  }
+  // start the threads, each with a consecutive range of cards
+  vector<unique_ptr<CardUpdateThread>> threads;
+  vector<bool> running;
+  for (int t = 0 ; t < thread_count ; ++t) {
+    size_t begin = set.cards.size() *  t      / thread_count;
+    size_t end   = set.cards.size() * (t + 1) / thread_count;
+    threads.push_back(make_unique<CardUpdateThread>(set, begin, end, skip));
+    running.push_back(threads.back()->Run() == wxTHREAD_NO_ERROR);
+  }
+  // wait for them, report errors in the order of the cards
+  for (size_t t = 0 ; t < threads.size() ; ++t) {
+    if (running[t]) {
+      threads[t]->Wait();
+    } else {
+      threads[t]->update(); // the thread could not be started, do it here
+    }
+    FOR_EACH(e, threads[t]->errors) {
+      handle_error(ScriptError(e));
+    }
+  }
+}
+
 void SetScriptManager::updateAllDependend(const vector<Dependency>& dependent_scripts, const CardP& card) {
-  deque<ToUpdate> to_update;
+  UpdateQueue to_update;
   Age starting_age;
   alsoUpdate(to_update, dependent_scripts, card);
   updateRecursive(to_update, starting_age);
 }
 
-void SetScriptManager::updateRecursive(deque<ToUpdate>& to_update, Age starting_age) {
+void SetScriptManager::UpdateQueue::push(Value* value, const CardP& card) {
+  if (queued.insert(value).second) {
+    queue.push(ToUpdate(value, card, value->fieldP->update_order, seq++));
+  }
+}
+
+SetScriptManager::ToUpdate SetScriptManager::UpdateQueue::pop() {
+  ToUpdate u = queue.top();
+  queue.pop();
+  queued.erase(u.value);
+  return u;
+}
+
+void SetScriptManager::updateRecursive(UpdateQueue& to_update, Age starting_age) {
   if (to_update.empty()) return;
-  set.clearOrderCache(); // clear caches before evaluating a round of scripts
   while (!to_update.empty()) {
-    updateToUpdate(to_update.front(), to_update, starting_age);
-    to_update.pop_front();
+    updateToUpdate(to_update.pop(), to_update, starting_age);
   }
 }
 
-void SetScriptManager::updateToUpdate(const ToUpdate& u, deque<ToUpdate>& to_update, Age starting_age) {
+void SetScriptManager::updateToUpdate(const ToUpdate& u, UpdateQueue& to_update, Age starting_age) {
   Age age = u.value->last_script_update;
   if (starting_age <= age)  return; // this value was already updated
   Context& ctx = getContext(u.card);
@@ -326,6 +501,7 @@ void SetScriptManager::updateToUpdate(const ToUpdate& u, deque<ToUpdate>& to_upd
     handle_error(ScriptError(e.what() + _("\n  while updating value '") + u.value->fieldP->name + _("'")));
   }
   if (changes) {
+    valueChanged(u.card);
     // changed, send event
     ScriptValueEvent change(u.card.get(), u.value);
     set.actions.tellListeners(change, false);
@@ -341,17 +517,24 @@ void SetScriptManager::updateToUpdate(const ToUpdate& u, deque<ToUpdate>& to_upd
   #endif
 }
 
-void SetScriptManager::alsoUpdate(deque<ToUpdate>& to_update, const vector<Dependency>& deps, const CardP& card) {
+void SetScriptManager::valueChanged(const CardP& card) {
+  // the order of cards (see Set::positionOfCard) can depend on anything,
+  // but a card value only affects the position of that card
+  if (card) set.clearOrderCache(card);
+  else      set.clearOrderCache();
+}
+
+void SetScriptManager::alsoUpdate(UpdateQueue& to_update, const vector<Dependency>& deps, const CardP& card) {
   FOR_EACH_CONST(d, deps) {
     switch (d.type) {
       case DEP_SET_FIELD: {
         ValueP value = set.data.at(d.index);
-        to_update.push_back(ToUpdate(value.get(), CardP()));
+        to_update.push(value.get(), CardP());
         break;
       } case DEP_CARD_FIELD: {
         if (card) {
           ValueP value = card->data.at(d.index);
-          to_update.push_back(ToUpdate(value.get(), card));
+          to_update.push(value.get(), card);
           break;
         } else {
           // There is no card, so the update should affect all cards (fall through).
@@ -360,7 +543,7 @@ void SetScriptManager::alsoUpdate(deque<ToUpdate>& to_update, const vector<Depen
         // something invalidates a card value for all cards, so all cards need updating
         FOR_EACH(card, set.cards) {
           ValueP value = card->data.at(d.index);
-          to_update.push_back(ToUpdate(value.get(), card));
+          to_update.push(value.get(), card);
         }
         break;
       } case DEP_CARD_STYLE: {
@@ -380,7 +563,7 @@ void SetScriptManager::alsoUpdate(deque<ToUpdate>& to_update, const vector<Depen
           StyleSheet* stylesheet_card = &set.stylesheetFor(card);
           if (stylesheet == stylesheet_card) {
             ValueP value = card->extra_data.at(d.index);
-            to_update.push_back(ToUpdate(value.get(), card));
+            to_update.push(value.get(), card);
           }
         }*/
         break;
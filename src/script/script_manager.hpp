@@ -14,6 +14,7 @@
 #include <script/context.hpp>
 #include <script/dependency.hpp>
 #include <queue>
+#include <unordered_set>
 
 class Set;
 class Value;
@@ -71,10 +72,16 @@ public:
   void updateAll();
   
 private:
+  /// Update the fields of all cards using multiple threads
+  /** Fields that depend on the card list are not updated */
+  void updateAllCardsInParallel(int thread_count);
+
   void onInit(const StyleSheetP& stylesheet, Context& ctx) override;
   
   void initDependencies(Context&, Game&);
   void initDependencies(Context&, StyleSheet&);
+  /// Determine Field::update_order for all fields of the game, from the dependencies between them
+  void initUpdateOrder(Game&);
   
   /// Update a map of styles
   void updateStyles(Context& ctx, const IndexMap<FieldP,StyleP>& styles, bool only_content_dependent);
@@ -86,17 +93,41 @@ private:
   
   // Something that needs to be updated
   struct ToUpdate {
-    ToUpdate(Value* value, CardP card) : value(value), card(card) {}
+    ToUpdate(Value* value, CardP card, int order, size_t seq) : value(value), card(card), order(order), seq(seq) {}
     Value* value;  ///< value to update
     CardP  card;   ///< card the value is in, or CadP() if it is not a card field
+    int    order;  ///< update_order of the field
+    size_t seq;    ///< when was this added to the queue? for updating in a predictable order
+    /// Should this be updated after other?
+    inline bool operator < (const ToUpdate& other) const {
+      return order > other.order || (order == other.order && seq > other.seq);
+    }
+  };
+  /// Values that need updating, updated in order of their field's update_order
+  /** Because values are only updated after everything they depend on,
+   *  every value is updated at most once (unless the dependencies contain a cycle).
+   */
+  class UpdateQueue {
+  public:
+    /// Add a value to the queue, if it is not already in there
+    void push(Value* value, const CardP& card);
+    /// Remove the next value to update from the queue
+    ToUpdate pop();
+    inline bool empty() const { return queue.empty(); }
+  private:
+    priority_queue<ToUpdate> queue;
+    unordered_set<Value*> queued;      ///< Values currently in the queue
+    size_t seq = 0;
   };
   /// Update all things in to_update, and things that depent on them, etc.
   /** Only update things that are older than starting_age. */
-  void updateRecursive(deque<ToUpdate>& to_update, Age starting_age);
+  void updateRecursive(UpdateQueue& to_update, Age starting_age);
+  /// A value of a card (or of the set if !card) has changed, update the order cache of the set
+  void valueChanged(const CardP& card);
   /// Update a value given by a ToUpdate object, and add things depending on it to to_update
-  void updateToUpdate(const ToUpdate& u, deque<ToUpdate>& to_update, Age starting_age);
+  void updateToUpdate(const ToUpdate& u, UpdateQueue& to_update, Age starting_age);
   /// Schedule all things in deps to be updated by adding them to to_update
-  void alsoUpdate(deque<ToUpdate>& to_update, const vector<Dependency>& deps, const CardP& card);
+  void alsoUpdate(UpdateQueue& to_update, const vector<Dependency>& deps, const CardP& card);
   
   /// Delayed update for (bitmask)...
   enum Delay
@@ -11,6 +11,7 @@
 #include <script/context.hpp>
 #include <script/parser.hpp>
 #include <script/script.hpp>
+#include <script/script_cache.hpp>
 #include <script/value.hpp>
 #include <gfx/color.hpp>
 
@@ -46,8 +47,12 @@ ScriptValueP OptionalScript::invoke(Context& ctx, bool open_scope) const {
 }
 
 void OptionalScript::parse(Reader& reader, bool string_mode) {
+  // compiled before?
+  ScriptCache* cache = script_cache();
+  if (cache && (script = cache->find(unparsed, string_mode))) return;
   vector<ScriptParseError> errors;
   script = ::parse(unparsed, reader.getPackage(), string_mode, errors);
+  if (cache && script && errors.empty()) cache->add(unparsed, string_mode, *script);
   // show parse errors as warnings
   String include_warnings;
   for (size_t i = 0 ; i < errors.size() ; ++i) {
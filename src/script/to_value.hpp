@@ -155,6 +155,11 @@ ScriptValueP get_member(const Container& m, const String& name) {
   }
 }
 
+template <typename Container>
+ScriptValueP get_member(const Container& m, const String& name, IndexHint&) {
+  return get_member(m, name);
+}
+
 template <typename K, typename V>
 ScriptValueP get_member(const IndexMap<K,V>& m, const String& name) {
   typename IndexMap<K,V>::const_iterator it = m.find(name);
@@ -165,6 +170,16 @@ ScriptValueP get_member(const IndexMap<K,V>& m, const String& name) {
   }
 }
 
+template <typename K, typename V>
+ScriptValueP get_member(const IndexMap<K,V>& m, const String& name, IndexHint& hint) {
+  typename IndexMap<K,V>::const_iterator it = m.find(name, hint);
+  if (it != m.end()) {
+    return to_script(*it);
+  } else {
+    return delay_error(ScriptErrorNoMember(_TYPE_("collection"), name));
+  }
+}
+
 /// Script value containing a map-like collection
 template <typename Collection>
 class ScriptMap : public ScriptValue {
@@ -175,6 +190,9 @@ public:
   ScriptValueP getMember(const String& name) const override {
     return get_member(*value, name);
   }
+  ScriptValueP getMemberWithHint(const String& name, IndexHint& hint) const override {
+    return get_member(*value, name, hint);
+  }
   int itemCount() const override { return (int)value->size(); }
   ScriptValueP dependencyMember(const String& name, const Dependency& dep) const override {
     mark_dependency_member(*value, name, dep);
@@ -267,23 +285,10 @@ public:
     ScriptValueP d = getDefault(); return d ? d->toImage() : ScriptValue::toImage();
   }
   ScriptValueP getMember(const String& name) const override {
-    #if USE_SCRIPT_PROFILING
-      Timer t;
-      Profiler prof(t, (void*)mangled_name(typeid(T)), _("get member of ") + type_name(*value));
-    #endif
-    // Use reflection to find the member of the object
-    GetMember gm(name);
-    gm.handle(*value);
-    if (gm.result()) return gm.result();
-    else {
-      // try nameless member
-      ScriptValueP d = getDefault();
-      if (d) {
-        return d->getMember(name);
-      } else {
-        return ScriptValue::getMember(name);
-      }
-    }
+    return findMember(name, nullptr);
+  }
+  ScriptValueP getMemberWithHint(const String& name, IndexHint& hint) const override {
+    return findMember(name, &hint);
   }
   ScriptValueP getIndex(int index) const override {
     ScriptValueP d = getDefault(); return d ? d->getIndex(index) : ScriptValue::getIndex(index);
@@ -328,6 +333,25 @@ private:
     gdm.handle(*value);
     return gdm.result();
   }
+  ScriptValueP findMember(const String& name, IndexHint* hint) const {
+    #if USE_SCRIPT_PROFILING
+      Timer t;
+      Profiler prof(t, (void*)mangled_name(typeid(T)), _("get member of ") + type_name(*value));
+    #endif
+    // Use reflection to find the member of the object
+    GetMember gm(name, hint);
+    gm.handle(*value);
+    if (gm.result()) return gm.result();
+    else {
+      // try nameless member
+      ScriptValueP d = getDefault();
+      if (d) {
+        return hint ? d->getMemberWithHint(name, *hint) : d->getMember(name);
+      } else {
+        return ScriptValue::getMember(name);
+      }
+    }
+  }
 };
 
 // ----------------------------------------------------------------------------- : Default arguments / closure
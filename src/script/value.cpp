@@ -14,6 +14,88 @@
 #include <gfx/generated_image.hpp>
 #include <util/error.hpp>
 #include <boost/pool/singleton_pool.hpp>
+#include <cmath>
+
+// ----------------------------------------------------------------------------- : Allocation
+
+#if USE_SCRIPT_VALUE_RECYCLING
+
+// Evaluating a script creates and destroys many short lived values: strings, closures, iterators, etc.
+// The memory of a destroyed value is kept in a free list for its size class, and used for the next
+// value of the same size. There are free lists for each thread, so no locking is needed.
+// Memory can be freed by a different thread than the one that allocated it, it just moves to the other list.
+// Values can also be destroyed by thread_local and static objects when the thread exits, after its lists
+// are freed. So the lists are reached through a trivially destructible pointer, that is null after that.
+
+const size_t SCRIPT_VALUE_GRANULARITY  = 16;
+const size_t SCRIPT_VALUE_SIZE_CLASSES = 8;    // recycle values of up to 128 bytes
+const size_t SCRIPT_VALUE_MAX_FREE     = 4096; // per size class and thread
+
+struct ScriptValueFreeLists {
+  void*  head [SCRIPT_VALUE_SIZE_CLASSES] = {};
+  size_t count[SCRIPT_VALUE_SIZE_CLASSES] = {};
+  
+  ~ScriptValueFreeLists() {
+    for (size_t c = 0 ; c < SCRIPT_VALUE_SIZE_CLASSES ; ++c) {
+      while (void* p = head[c]) {
+        head[c] = *static_cast<void**>(p);
+        ::operator delete(p);
+      }
+    }
+  }
+};
+// these are trivially destructible, so they can still be used while other thread_locals are destroyed
+thread_local ScriptValueFreeLists* script_value_free_lists = nullptr;
+thread_local bool script_value_free_lists_closed = false; ///< The thread is exiting, values are no longer recycled
+
+/// Frees the free lists of a thread when it exits
+struct ScriptValueFreeListsOwner {
+  ~ScriptValueFreeListsOwner() {
+    script_value_free_lists_closed = true;
+    delete script_value_free_lists;
+    script_value_free_lists = nullptr;
+  }
+};
+thread_local ScriptValueFreeListsOwner script_value_free_lists_owner;
+
+/// The free lists of the current thread, or nullptr if the thread is exiting
+inline ScriptValueFreeLists* free_lists() {
+  ScriptValueFreeLists* lists = script_value_free_lists;
+  if (!lists && !script_value_free_lists_closed) {
+    lists = script_value_free_lists = new ScriptValueFreeLists;
+    (void)&script_value_free_lists_owner; // using the owner makes sure that it is destroyed at thread exit
+  }
+  return lists;
+}
+
+void* ScriptValue::operator new(size_t size) {
+  size_t c = (size - 1) / SCRIPT_VALUE_GRANULARITY;
+  if (c >= SCRIPT_VALUE_SIZE_CLASSES) return ::operator new(size);
+  ScriptValueFreeLists* lists = free_lists();
+  if (void* p = lists ? lists->head[c] : nullptr) {
+    lists->head[c] = *static_cast<void**>(p);
+    lists->count[c]--;
+    return p;
+  }
+  // allocate the full size of the class, so the memory can be reused for any value in it
+  return ::operator new((c + 1) * SCRIPT_VALUE_GRANULARITY);
+}
+
+void ScriptValue::operator delete(void* p, size_t size) {
+  size_t c = (size - 1) / SCRIPT_VALUE_GRANULARITY;
+  if (c < SCRIPT_VALUE_SIZE_CLASSES) {
+    ScriptValueFreeLists* lists = free_lists();
+    if (lists && lists->count[c] < SCRIPT_VALUE_MAX_FREE) {
+      *static_cast<void**>(p) = lists->head[c];
+      lists->head[c] = p;
+      lists->count[c]++;
+      return;
+    }
+  }
+  ::operator delete(p);
+}
+
+#endif
 
 // ----------------------------------------------------------------------------- : ScriptValue
 // Base cases
@@ -61,6 +143,9 @@ CompareWhat  ScriptValue::compareAs(String& compare_str, void const*& compare_pt
   compare_str = toCode();
   return COMPARE_AS_STRING;
 }
+ScriptValueP ScriptValue::getMemberWithHint(const String& name, IndexHint&) const {
+  return getMember(name);
+}
 ScriptValueP ScriptValue::getMember(const String& name) const {
   long index;
   if (name.ToLong(&index)) {
@@ -241,7 +326,22 @@ private:
   }
 #endif
 
+// Integers in this range are preallocated, so loop counters, indices and most arithmetic don't allocate
+const int SMALL_INT_MIN = -256;
+const int SMALL_INT_MAX = 1023;
+
 ScriptValueP to_script(int v) {
+  // Note: the table is never freed, because values in it can be referenced by globals that are destroyed later
+  static const ScriptValueP* small_ints = [] {
+    ScriptValueP* ints = new ScriptValueP[SMALL_INT_MAX - SMALL_INT_MIN + 1];
+    for (int i = SMALL_INT_MIN ; i <= SMALL_INT_MAX ; ++i) {
+      ints[i - SMALL_INT_MIN] = make_intrusive<ScriptInt>(i);
+    }
+    return ints;
+  }();
+  if (v >= SMALL_INT_MIN && v <= SMALL_INT_MAX) {
+    return small_ints[v - SMALL_INT_MIN];
+  }
 #if USE_POOL_ALLOCATOR
   #if USE_INTRUSIVE_PTR
     return ScriptValueP(
@@ -290,12 +390,55 @@ public:
   String toString() const override { return String() << value; }
   double toDouble() const override { return value; }
   int toInt() const override { return (int)value; }
+protected:
+#if USE_POOL_ALLOCATOR
+  void destroy() const override {
+    boost::singleton_pool<ScriptValue, sizeof(ScriptDouble)>::free(this);
+  }
+#endif
 private:
   double value;
 };
 
+#if USE_POOL_ALLOCATOR && !USE_INTRUSIVE_PTR
+  // deallocation function for pool allocated doubles
+  void destroy_value(ScriptDouble* v) {
+    boost::singleton_pool<ScriptValue, sizeof(ScriptDouble)>::free(v);
+  }
+#endif
+
+// Doubles that are a whole number or a half in the range of small integers are preallocated,
+// the results of most arithmetic on card values are like that
+const int SMALL_DOUBLE_STEPS = 2; // per unit
+
 ScriptValueP to_script(double v) {
+  // Note: the table is never freed, because values in it can be referenced by globals that are destroyed later
+  static const ScriptValueP* small_doubles = [] {
+    ScriptValueP* doubles = new ScriptValueP[(SMALL_INT_MAX - SMALL_INT_MIN) * SMALL_DOUBLE_STEPS + 1];
+    for (int i = SMALL_INT_MIN * SMALL_DOUBLE_STEPS ; i <= SMALL_INT_MAX * SMALL_DOUBLE_STEPS ; ++i) {
+      doubles[i - SMALL_INT_MIN * SMALL_DOUBLE_STEPS] = make_intrusive<ScriptDouble>((double)i / SMALL_DOUBLE_STEPS);
+    }
+    return doubles;
+  }();
+  double steps = v * SMALL_DOUBLE_STEPS;
+  if (steps >= SMALL_INT_MIN * SMALL_DOUBLE_STEPS && steps <= SMALL_INT_MAX * SMALL_DOUBLE_STEPS
+      && steps == (int)steps && !(v == 0 && std::signbit(v))) { // -0.0 is printed differently from 0.0
+    return small_doubles[(int)steps - SMALL_INT_MIN * SMALL_DOUBLE_STEPS];
+  }
+#if USE_POOL_ALLOCATOR
+  #if USE_INTRUSIVE_PTR
+    return ScriptValueP(
+        new(boost::singleton_pool<ScriptValue, sizeof(ScriptDouble)>::malloc())
+          ScriptDouble(v));
+  #else
+    return ScriptValueP(
+        new(boost::singleton_pool<ScriptValue, sizeof(ScriptDouble)>::malloc())
+          ScriptDouble(v),
+        destroy_value); // deallocation function
+  #endif
+#else
   return make_intrusive<ScriptDouble>(v);
+#endif
 }
 
 // ----------------------------------------------------------------------------- : String type
@@ -10,6 +10,13 @@
 
 #include <util/prec.hpp>
 #include <gfx/color.hpp>
+
+/// Reuse the memory of script values instead of returning it to the heap
+/** Only makes sense with intrusive pointers, shared_ptr does its own allocation */
+#ifndef USE_SCRIPT_VALUE_RECYCLING
+  #define USE_SCRIPT_VALUE_RECYCLING USE_INTRUSIVE_PTR
+#endif
+
 class Context;
 class Dependency;
 class ScriptClosure;
@@ -48,6 +55,15 @@ enum CompareWhat
 class ScriptValue : public IntrusivePtrBaseWithDelete {
 public:
   virtual ~ScriptValue() {}
+  
+  #if USE_SCRIPT_VALUE_RECYCLING
+    /// Allocate memory for a value, from a free list for this thread if possible
+    static void* operator new(size_t size);
+    static void* operator new(size_t, void* place) { return place; }
+    /// Put the memory of a value in the free list for this thread
+    static void operator delete(void* p, size_t size);
+    static void operator delete(void*, void*) {}
+  #endif
 
   /// Information on the type of this value
   virtual ScriptType type() const = 0;
@@ -77,6 +93,9 @@ public:
 
   /// Get a member variable from this value
   virtual ScriptValueP getMember(const String& name) const;
+  /// Get a member variable from this value, the hint speeds up repeated lookups of the same name
+  /** Used for member access in scripts, each place where a member is accessed has its own hint */
+  virtual ScriptValueP getMemberWithHint(const String& name, IndexHint& hint) const;
 
   /// Signal that a script depends on this value itself
   virtual void dependencyThis(const Dependency& dep);
@@ -10,8 +10,28 @@
 
 #include <vector>
 #include <map>
+#include <atomic>
 #include <util/string.hpp>
 
+// ----------------------------------------------------------------------------- : IndexHint
+
+/// Remembers at which position IndexMap::find found a name
+/** Maps with the same keys have their values at the same positions,
+ *  so looking up the same name again only needs a single comparison.
+ *  A hint can be shared between threads, a stale hint just means a normal search.
+ */
+class IndexHint {
+public:
+  inline IndexHint() : index(0) {}
+  inline IndexHint(const IndexHint& that) : index(that.get()) {}
+  inline IndexHint& operator = (const IndexHint& that) { set(that.get()); return *this; }
+  
+  inline size_t get() const { return index.load(std::memory_order_relaxed); }
+  inline void set(size_t i) { index.store(i, std::memory_order_relaxed); }
+private:
+  std::atomic<size_t> index;
+};
+
 // ----------------------------------------------------------------------------- : IndexMap
 
 /// A kind of map of Key->Value, with the following properties:
@@ -112,6 +132,15 @@ public:
     }
     return end();
   }
+  /// Find a value given the key name, first trying the position given by the hint
+  template <typename Name>
+  typename vector<Value>::const_iterator find(const Name& key, IndexHint& hint) const {
+    size_t index = hint.get();
+    if (index < size() && get_key_name(at(index)) == key) return begin() + index;
+    typename vector<Value>::const_iterator it = find(key);
+    if (it != end()) hint.set(it - begin());
+    return it;
+  }
   
   inline void swap(IndexMap& b) {
     vector<Value>::swap(b);
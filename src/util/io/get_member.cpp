@@ -32,8 +32,9 @@ template <> void GetDefaultMember::handle(const wxDateTime&   v) { value = to_sc
 
 // ----------------------------------------------------------------------------- : GetMember
 
-GetMember::GetMember(const String& name)
+GetMember::GetMember(const String& name, IndexHint* hint)
   : target_name(name)
+  , hint(hint)
 {}
 
 // caused by the pattern: if (!handler.isCompound()) { REFLECT_NAMELESS(stuff) }
@@ -74,7 +74,8 @@ private:
 class GetMember {
 public:
   /// Construct a member getter that looks for the given name
-  GetMember(const String& name);
+  /** If a hint is given it is used for finding the name in index maps */
+  GetMember(const String& name, IndexHint* hint = nullptr);
   
   /// Tell the reflection code we are getting a member for scripting purposes
   static constexpr bool isReading = false;
@@ -103,18 +104,15 @@ public:
   /// Handle an index map: invistigate keys
   template <typename K, typename V> void handle(const IndexMap<K,V>& m) {
     if (gdm.result()) return;
-    for (typename IndexMap<K,V>::const_iterator it = m.begin() ; it != m.end() ; ++it) {
-      if (get_key_name(*it) == target_name) {
-        gdm.handle(*it);
-        return;
-      }
-    }
+    typename IndexMap<K,V>::const_iterator it = hint ? m.find(target_name, *hint) : m.find(target_name);
+    if (it != m.end()) gdm.handle(*it);
   }
   template <typename K, typename V> void handle(const DelayedIndexMaps<K,V>&);
   template <typename K, typename V> void handle(const DelayedIndexMapsData<K,V>&);
   
 private:
   const String& target_name;  ///< The name we are looking for
+  IndexHint* hint;            ///< Hint for finding target_name in index maps, or nullptr
   GetDefaultMember gdm;    ///< Object to store and retrieve the value
 };
 
@@ -12,6 +12,7 @@
 #include <util/error.hpp>
 #include <script/to_value.hpp> // for reflection
 #include <script/profiler.hpp> // for PROFILER
+#include <script/script_cache.hpp>
 #include <wx/wfstream.h>
 #include <wx/zipstrm.h>
 #include <wx/dir.h>
@@ -85,6 +86,8 @@ void Package::reopen() {
   if (wxDirExists(filename)) {
     // make sure we have no zip open
     zipStream.reset();
+    wxMutexLocker locker(lock);
+    zipArchive.reset();
   } else {
     // reopen only needed for zipfile
     openZipfile();
@@ -104,7 +107,10 @@ void Package::saveAs(const String& name, bool remove_unused, bool as_directory)
   } else {
     saveToZipfile  (name, remove_unused, false);
   }
-  filename = name;
+  {
+    wxMutexLocker locker(lock);
+    filename = name;
+  }
   removeTempFiles(remove_unused);
   reopen();
 }
@@ -115,6 +121,7 @@ void Package::saveCopy(const String& name) {
 }
 
 void Package::removeTempFiles(bool remove_unused) {
+  wxMutexLocker locker(lock);
   // cleanup : remove temp files, remove deleted files from the list
   FileInfos::iterator it = files.begin();
   while (it != files.end()) {
@@ -192,34 +199,81 @@ unique_ptr<wxInputStream> Package::openIn(const String& file) {
     Packaged* p = dynamic_cast<Packaged*>(this);
     return package_manager.openFileFromPackage(p, file).first;
   }
-  FileInfos::iterator it = files.find(normalize_internal_filename(file));
-  if (it == files.end()) {
+  // look up the file, copy what we need, so the table can change while we open the file
+  String name = normalize_internal_filename(file);
+  String disk_name = file;
+  String package_file, temp_name;
+  ZipArchiveP zip_archive;
+  bool found;
+  {
+    wxMutexLocker locker(lock);
+    auto duplicate = duplicates.find(name);
+    if (duplicate != duplicates.end()) {
+      // the file was saved as another file with the same contents
+      name = disk_name = duplicate->second;
+    }
+    FileInfos::const_iterator it = files.find(name);
+    found = it != files.end();
+    package_file = filename;
+    if (found) {
+      temp_name   = it->second.tempName;
+      zip_archive = zipArchive;
+    }
+  }
+  if (!found) {
     // does it look like a relative filename?
-    if (filename.find(_(".mse-")) != String::npos) {
-      throw PackageError(_ERROR_2_("file not found package like", file, filename));
+    if (package_file.find(_(".mse-")) != String::npos) {
+      throw PackageError(_ERROR_2_("file not found package like", file, package_file));
     }
   }
   unique_ptr<wxInputStream> stream;
-  if (it != files.end() && it->second.wasWritten()) {
+  if (!temp_name.empty()) {
     // written to this file, open the temp file
-    stream = make_unique<wxFileInputStream>(it->second.tempName);
-  } else if (wxFileExists(filename+_("/")+file)) {
+    stream = make_unique<wxFileInputStream>(temp_name);
+  } else if (zip_archive && (stream = zip_archive->openIn(name))) {
+    // a file in a zip archive, read from memory
+  } else if (wxFileExists(package_file+_("/")+disk_name)) {
     // a file in directory package
-    stream = make_unique<wxFileInputStream>(filename+_("/")+file);
-  } else if (wxFileExists(filename) && it != files.end() && it->second.zipEntry) {
-    // a file in a zip archive
-    stream = make_unique<ZipFileInputStream>(filename, it->second.zipEntry);
+    stream = make_unique<wxFileInputStream>(package_file+_("/")+disk_name);
+  } else if (found && wxFileExists(package_file)) {
+    // a file in a zip archive that can't be read from memory, open it with a stream of its own
+    unique_ptr<wxZipEntry> zip_entry;
+    {
+      wxMutexLocker locker(lock);
+      FileInfos::const_iterator it = files.find(name);
+      if (it != files.end() && it->second.zipEntry) zip_entry.reset(it->second.zipEntry->Clone());
+    }
+    if (zip_entry) stream = make_unique<ZipFileInputStream>(package_file, zip_entry.get());
   } else {
     // shouldn't happen, packaged changed by someone else since opening it
-    throw FileNotFoundError(file, filename);
+    throw FileNotFoundError(file, package_file);
   }
   if (!stream || !stream->IsOk()) {
-    throw FileNotFoundError(file, filename);
+    throw FileNotFoundError(file, package_file);
   } else {
     return stream;
   }
 }
 
+String Package::fileStamp(const String& file) {
+  if (!file.empty() && file.GetChar(0) == _('/')) {
+    // absolute path, a file in another package
+    auto [package, name] = package_manager.findFileInPackage(dynamic_cast<Packaged*>(this), file);
+    return package->fileStamp(name);
+  }
+  String name = normalize_internal_filename(file);
+  wxMutexLocker locker(lock);
+  auto duplicate = duplicates.find(name);
+  if (duplicate != duplicates.end()) name = duplicate->second;
+  FileInfos::const_iterator it = files.find(name);
+  if (it == files.end()) return wxEmptyString;
+  // a written file is in a temp file, which changes when the file is written again
+  String stamp = it->second.wasWritten() ? it->second.tempName : filename + _("/") + name;
+  DateTime time = modificationTime(*it);
+  if (time.IsValid()) stamp += _("@") + time.GetValue().ToString();
+  return stamp;
+}
+
 unique_ptr<wxOutputStream> Package::openOut(const String& file) {
   return make_unique<wxFileOutputStream>(nameOut(file));
 }
@@ -227,6 +281,9 @@ unique_ptr<wxOutputStream> Package::openOut(const String& file) {
 String Package::nameOut(const String& file) {
   assert(wxThread::IsMain()); // Writing should only be done from the main thread
   String name = normalize_internal_filename(file);
+  detachDuplicates(name);
+  wxMutexLocker locker(lock);
+  duplicates.erase(name); // the file gets contents of its own
   FileInfos::iterator it = files.find(name);
   if (it == files.end()) {
     // new file
@@ -255,10 +312,11 @@ LocalFileName Package::newFileName(const String& prefix, const String& suffix) {
     name << ++infix;
     name += suffix;
     name = normalize_internal_filename(name);
-    // check if a file with that name exists
+    // check if a file with that name exists, or existed before it was found to be a duplicate
     FileInfos::iterator it = files.find(name);
-    if (it == files.end()) {
+    if (it == files.end() && duplicates.find(name) == duplicates.end()) {
       // name doesn't exist yet
+      wxMutexLocker locker(lock);
       it = addFile(name);
       it->second.created = true;
       return name;
@@ -266,6 +324,93 @@ LocalFileName Package::newFileName(const String& prefix, const String& suffix) {
   }
 }
 
+/// Do two streams have the same contents?
+bool same_contents(wxInputStream& a, wxInputStream& b) {
+  const size_t BLOCK_SIZE = 64 * 1024;
+  vector<char> block_a(BLOCK_SIZE), block_b(BLOCK_SIZE);
+  while (true) {
+    size_t size_a = a.Read(block_a.data(), BLOCK_SIZE).LastRead();
+    size_t size_b = b.Read(block_b.data(), BLOCK_SIZE).LastRead();
+    if (size_a != size_b || memcmp(block_a.data(), block_b.data(), size_a) != 0) return false;
+    if (size_a < BLOCK_SIZE) return true;
+  }
+}
+
+void Package::findDuplicateFiles() {
+  assert(wxThread::IsMain());
+  // only files with the same size can have the same contents,
+  // files that were already in the package come first, so they are the ones that are kept
+  map<wxFileOffset, vector<String>> by_size;
+  vector<String> written;
+  FOR_EACH(f, files) {
+    if (f.second.wasWritten()) {
+      written.push_back(f.first);
+    } else if (duplicates.find(f.first) == duplicates.end()) {
+      wxFileOffset size = fileSize(f);
+      if (size > 0) by_size[size].push_back(f.first);
+    }
+  }
+  FOR_EACH(w, written) {
+    if (duplicates.find(w) != duplicates.end()) continue;
+    wxFileOffset size = fileSize(*files.find(w));
+    if (size <= 0) continue;
+    vector<String>& same_size = by_size[size];
+    String original;
+    try {
+      auto w_stream = openIn(w);
+      FOR_EACH(o, same_size) {
+        auto o_stream = openIn(o);
+        if (same_contents(*w_stream, *o_stream)) {
+          original = o;
+          break;
+        }
+        w_stream = openIn(w); // start again for the next comparison
+      }
+    } catch (const Error&) {
+      continue; // the file can't be read, so it isn't a duplicate either
+    }
+    if (original.empty()) {
+      same_size.push_back(w);
+    } else {
+      wxMutexLocker locker(lock);
+      duplicates[w] = original;
+    }
+  }
+}
+
+void Package::detachDuplicates(const String& name) {
+  vector<String> aliases;
+  {
+    wxMutexLocker locker(lock);
+    FOR_EACH(d, duplicates) {
+      if (d.second == name) aliases.push_back(d.first);
+    }
+  }
+  FOR_EACH(alias, aliases) {
+    // copy the current contents to a temp file of the duplicate
+    String temp_name = wxFileName::CreateTempFileName(_("mse"));
+    {
+      auto in = openIn(name);
+      wxFileOutputStream out(temp_name);
+      out.Write(*in);
+      if (!out.IsOk() || !out.Close()) throw PackageError(_ERROR_("unable to store file"));
+    }
+    wxMutexLocker locker(lock);
+    duplicates.erase(alias);
+    FileInfos::iterator it = files.find(alias);
+    if (it == files.end()) {
+      it = addFile(alias);
+      it->second.created = true;
+    }
+    it->second.tempName = temp_name;
+  }
+}
+
+String Package::uniqueFile(const String& file) const {
+  auto it = duplicates.find(normalize_internal_filename(file));
+  return it == duplicates.end() ? file : it->second;
+}
+
 void Package::referenceFile(const String& file) {
   if (file.empty()) return;
   FileInfos::iterator it = files.find(file);
@@ -277,19 +422,21 @@ void Package::referenceFile(const String& file) {
 
 String Package::absoluteName(const LocalFileName& file) {
   assert(wxThread::IsMain());
-  FileInfos::iterator it = files.find(normalize_internal_filename(file.fn));
+  // a duplicate file is stored as its original
+  String name = normalize_internal_filename(uniqueFile(file.fn));
+  FileInfos::iterator it = files.find(name);
   if (it == files.end()) {
     throw FileNotFoundError(file.fn, filename);
   }
   if (it->second.wasWritten()) {
     // written to this file, return the temp file
     return it->second.tempName;
-  } else if (wxFileExists(filename + _("/") + file.fn)) {
+  } else if (wxFileExists(filename + _("/") + name)) {
     // dir package
-    return filename + _("/") + file.fn;
+    return filename + _("/") + name;
   } else {
     // assume zip package
-    return filename + _("\1") + file.fn;
+    return filename + _("\1") + name;
   }
 }
 // Open a file that is in some package
@@ -318,8 +465,9 @@ String LocalFileName::toStringForWriting() const {
       return String();
     }
   } else if (!fn.empty() && writing_package()) {
-    writing_package()->referenceFile(fn);
-    return fn;
+    String name = writing_package()->uniqueFile(fn); // files with the same contents are saved once
+    writing_package()->referenceFile(name);
+    return name;
   } else {
     return fn;
   }
@@ -355,14 +503,16 @@ Package::FileInfo::~FileInfo() {
 }
 
 void Package::loadZipStream() {
-  files.clear();
+  FileInfos new_files;
   while (true) {
     wxZipEntry* entry = zipStream->GetNextEntry();
     if (!entry) break;
     String name = normalize_internal_filename(entry->GetName(wxPATH_UNIX));
-    files[name].zipEntry = entry;
+    new_files[name].zipEntry = entry;
   }
   zipStream->CloseEntry();
+  wxMutexLocker locker(lock);
+  files.swap(new_files);
 }
 
 void Package::openDirectory(bool fast) {
@@ -392,11 +542,27 @@ void Package::openSubdir(const String& name) {
 }
 
 void Package::openZipfile() {
-  // open stream
+  // index the zip file, it knows all the entries
+  // if there is junk from an interrupted append, only the intact part is read, it is removed by the next save
+  ZipArchiveP archive = ZipArchive::open(filename);
+  if (archive) {
+    FileInfos new_files;
+    FOR_EACH_CONST(e, archive->getEntries()) {
+      new_files[e.first];
+    }
+    zipStream.reset();
+    wxMutexLocker locker(lock);
+    files.swap(new_files);
+    zipArchive = archive;
+    return;
+  }
+  // not a file we can index, open stream
   zipStream = make_unique<ZipFileInputStream>(filename);
   if (!zipStream->IsOk())  throw PackageError(_ERROR_1_("package not found", filename));
   // read zip entries
   loadZipStream();
+  wxMutexLocker locker(lock);
+  zipArchive.reset();
 }
 
 void Package::saveToDirectory(const String& saveAs, bool remove_unused, bool is_copy) {
@@ -443,43 +609,68 @@ void Package::saveToDirectory(const String& saveAs, bool remove_unused, bool is_
   }
 }
 
+/// Files are compressed in batches of at most this much data, to limit memory use
+const wxFileOffset SAVE_BATCH_SIZE  = 64 * 1024 * 1024;
+/// Also limit the number of files in a batch, each has an open input stream
+const size_t       SAVE_BATCH_FILES = 256;
+/// Changed files are only appended to the old zip file if they are at most this large in total
+const wxFileOffset APPEND_MAX_SIZE  = 4 * 1024 * 1024;
+
+/// Compress the files in a batch, and write them
+void write_batch(ZipWriter& zip, vector<ZipData>& batch) {
+  if (!ZipData::compressAll(batch)) throw PackageError(_ERROR_("unable to store file"));
+  FOR_EACH_CONST(f, batch) {
+    zip.write(f);
+  }
+  batch.clear();
+}
+
 void Package::saveToZipfile(const String& saveAs, bool remove_unused, bool is_copy) {
+  // when only a few small files changed, it is enough to append them to the old file
+  if (!is_copy && saveAs == filename && appendToZipfile(remove_unused)) return;
   // create a temporary zip file name
   String tempFile = saveAs + _(".tmp");
   remove_file(tempFile);
-  // open zip file
+  // write zip file
   try {
-    unique_ptr<wxFileOutputStream> newFile(new wxFileOutputStream(tempFile));
-    if (!newFile->IsOk()) throw PackageError(_ERROR_("unable to open output file"));
-    unique_ptr<wxZipOutputStream>  newZip(new wxZipOutputStream(*newFile));
-    if (!newZip->IsOk())  throw PackageError(_ERROR_("unable to open output file"));
-    // copy everything to a new zip file, unless it's updated or removed
-    if (zipStream) newZip->CopyArchiveMetaData(*zipStream);
+    wxFileOutputStream newFile(tempFile);
+    if (!newFile.IsOk()) throw PackageError(_ERROR_("unable to open output file"));
+    ZipWriter newZip(newFile);
+    // unchanged files in the old zip file are copied without decompressing them,
+    // changed files are compressed on multiple threads, a batch at a time
+    vector<ZipData> batch;
+    wxFileOffset batch_size = 0;
     FOR_EACH(f, files) {
       if (!f.second.keep && remove_unused) {
         // to remove a file simply don't copy it
-      } else if (!is_copy && f.second.zipEntry && !f.second.wasWritten()) {
-        // old file, was also in zip, not changed
-        // can't do this when saving a copy, since it destroys the zip entry
-        zipStream->CloseEntry();
-        newZip->CopyEntry(f.second.zipEntry, *zipStream);
-        f.second.zipEntry = 0;
-      } else {
-        // changed file, or the old package was not a zipfile
-        newZip->PutNextEntry(f.first);
-        auto temp_stream = openIn(f.first);
-        newZip->Write(*temp_stream);
+        continue;
+      }
+      batch.emplace_back();
+      ZipData& data = batch.back();
+      if (f.second.wasWritten() || !zipArchive || !zipArchive->rawData(f.first, data)) {
+        // changed file, or the old package was not a zipfile we can copy from
+        data.name  = f.first;
+        data.input = openIn(f.first);
+        batch_size += max((wxFileOffset)0, data.input->GetLength());
+      }
+      if (batch_size >= SAVE_BATCH_SIZE || batch.size() >= SAVE_BATCH_FILES) {
+        write_batch(newZip, batch);
+        batch_size = 0;
       }
     }
-    // close the old file
-    if (!is_copy) {
-      zipStream.reset();
-    }
+    write_batch(newZip, batch);
+    if (!newZip.close() || !newFile.Close()) throw PackageError(_ERROR_("unable to store file"));
   } catch (Error const& e) {
     // when things go wrong delete the temp file
     remove_file(tempFile);
     throw e;
   }
+  // close the old file
+  if (!is_copy) {
+    zipStream.reset();
+    wxMutexLocker locker(lock);
+    zipArchive.reset();
+  }
   // replace the old file with the new file, in effect commiting the changes
   if (wxFileExists(saveAs)) {
     // rename old file to .bak
@@ -487,19 +678,90 @@ void Package::saveToZipfile(const String& saveAs, bool remove_unused, bool is_co
     wxRenameFile(saveAs, saveAs + _(".bak"));
   }
   wxRenameFile(tempFile, saveAs);
-  // re-open zip file
-  filename = saveAs;
-  openZipfile();
+  // saveAs re-opens the zip file, a copy is not opened
 }
 
+bool Package::appendToZipfile(bool remove_unused) {
+  ZipArchiveP archive = zipArchive;
+  if (!archive) return false;
+  // compress the changed files, all other files must already be in the archive
+  vector<ZipData> changed;
+  wxFileOffset changed_size = 0;
+  size_t kept_size = 0;
+  FOR_EACH(f, files) {
+    if (!f.second.keep && remove_unused) continue;
+    if (f.second.wasWritten()) {
+      changed.emplace_back();
+      changed.back().name  = f.first;
+      changed.back().input = openIn(f.first);
+      changed_size += max((wxFileOffset)0, changed.back().input->GetLength());
+      if (changed_size > APPEND_MAX_SIZE) return false;
+    } else if (const ZipArchive::Entry* entry = archive->find(f.first)) {
+      kept_size += entry->stored_size;
+    } else {
+      return false;
+    }
+  }
+  // old versions of files stay in the file as unused space, don't let that grow too much
+  size_t old_size = archive->fileSize();
+  if (old_size - min(old_size, kept_size) > old_size / 4) return false;
+  // junk from an interrupted append is dropped by doing a full save instead
+  if (archive->intactSize() < old_size) return false;
+  if (!ZipData::compressAll(changed)) return false;
+  // keep a backup of the old file, like a full save does
+  remove_file(filename + _(".bak"));
+  if (!wxCopyFile(filename, filename + _(".bak"))) return false;
+  // append the changed files and a new central directory
+  bool ok;
+  {
+    wxFile file(filename, wxFile::write_append);
+    if (!file.IsOpened() || file.Length() != (wxFileOffset)old_size) return false;
+    wxFileOutputStream out(file);
+    ZipWriter zip(out, old_size);
+    vector<ZipData>::const_iterator next_changed = changed.begin();
+    FOR_EACH(f, files) {
+      if (!f.second.keep && remove_unused) continue;
+      if (f.second.wasWritten()) {
+        zip.write(*next_changed++);
+      } else {
+        zip.addExisting(f.first, *archive->find(f.first));
+      }
+    }
+    ok = zip.close() && file.Flush();
+  }
+  if (!ok) {
+    // the old central directory is still intact, remove what was appended, and do a full save instead
+    // if we crash before this, the file can still be read, and the next save removes the junk
+    ZipArchive::truncateFile(filename, old_size);
+  }
+  return ok;
+}
 
 Package::FileInfos::iterator Package::addFile(const String& name) {
   return files.insert(make_pair(normalize_internal_filename(name), FileInfo())).first;
 }
 
+wxFileOffset Package::fileSize(const pair<String, FileInfo>& fi) const {
+  wxULongLong size;
+  if (fi.second.wasWritten()) {
+    size = wxFileName::GetSize(fi.second.tempName);
+  } else if (const ZipArchive::Entry* entry = zipArchive ? zipArchive->find(fi.first) : nullptr) {
+    return entry->size;
+  } else if (fi.second.zipEntry) {
+    return fi.second.zipEntry->GetSize();
+  } else {
+    size = wxFileName::GetSize(filename+_("/")+fi.first);
+  }
+  return size == wxInvalidSize ? -1 : (wxFileOffset)size.GetValue();
+}
+
 DateTime Package::modificationTime(const pair<String, FileInfo>& fi) const {
   if (fi.second.wasWritten()) {
-    return wxFileName(fi.first).GetModificationTime();
+    return wxFileName(fi.second.tempName).GetModificationTime();
+  } else if (const ZipArchive::Entry* entry = zipArchive ? zipArchive->find(fi.first) : nullptr) {
+    DateTime time;
+    time.SetFromDOS(entry->dos_time);
+    return time;
   } else if (fi.second.zipEntry) {
     return fi.second.zipEntry->GetDateTime();
   } else if (wxFileExists(filename+_("/")+fi.first)) {
@@ -587,31 +849,52 @@ void Packaged::open(const String& package, bool just_header) {
   }
 }
 
+void Packaged::open(const String& package, const PackageHeader& header) {
+  Package::open(package);
+  fully_loaded = false;
+  short_name         = header.short_name;
+  full_name          = header.full_name;
+  icon_filename      = header.icon_filename;
+  position_hint      = header.position_hint;
+  installer_group    = header.installer_group;
+  version            = header.version;
+  compatible_version = header.compatible_version;
+  dependencies       = header.dependencies;
+}
+
 void Packaged::loadFully() {
   if (fully_loaded) return;
   auto stream = openIn(typeName());
   Reader reader(*stream, this, absoluteFilename() + _("/") + typeName());
+  // scripts that were compiled before are loaded from the cache
+  unique_ptr<ScriptCache> cache;
+  if (cacheScripts()) cache = make_unique<ScriptCache>(absoluteFilename(), lastModified());
+  WITH_DYNAMIC_ARG(script_cache, cache.get());
   try {
     reader.handle_greedy(*this);
     fully_loaded = true; // only after loading and validating succeeded, be careful with recursion!
   } catch (const ParseError& err) {
     throw FileParseError(err.what(), absoluteFilename() + _("/") + typeName()); // more detailed message
   }
+  if (cache) cache->save();
 }
 
 void Packaged::save() {
+  findDuplicateFiles();
   WITH_DYNAMIC_ARG(writing_package, this);
   writeFile(typeName(), *this, fileVersion());
   referenceFile(typeName());
   Package::save();
 }
 void Packaged::saveAs(const String& package, bool remove_unused, bool as_directory) {
+  findDuplicateFiles();
   WITH_DYNAMIC_ARG(writing_package, this);
   writeFile(typeName(), *this, fileVersion());
   referenceFile(typeName());
   Package::saveAs(package, remove_unused, as_directory);
 }
 void Packaged::saveCopy(const String& package) {
+  findDuplicateFiles();
   WITH_DYNAMIC_ARG(writing_package, this);
   writeFile(typeName(), *this, fileVersion());
   referenceFile(typeName());
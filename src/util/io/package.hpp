@@ -13,12 +13,14 @@
 #include <util/error.hpp>
 #include <util/file_utils.hpp>
 #include <util/vcs.hpp>
+#include <util/io/zip_archive.hpp>
 
 class Package;
 class wxFileInputStream;
 class wxZipInputStream;
 class wxZipEntry;
 DECLARE_POINTER_TYPE(PackageDependency);
+class PackageHeader;
 
 /// The package that is currently being written to
 DECLARE_DYNAMIC_ARG(Package*, writing_package);
@@ -70,13 +72,19 @@ private:
  *  To accomplish this modified files are first written to temporary files, when save() is called
  *  the temporary files are moved/copied.
  *
- *  Zip files are accessed using wxZip(Input|Output)Stream.
- *  The zip input stream appears to only allow one file at a time, since the stream itself maintains
- *  state about what file we are reading.
- *  There are multiple solutions:
- *    1. (currently used) Open a new ZipInputStream for each file
- *    2. (may be faster) First read the file into a memory buffer,
- *      return a stream based on that buffer (StringInputStream).
+ *  Zip files are read using a ZipArchive, which maps the file into memory and indexes it once.
+ *  If that is not possible (e.g. zip64 files), a new wxZipInputStream is opened for each file instead.
+ *  Zip files are written using a ZipWriter:
+ *    - unchanged files are copied from the old file without decompressing them,
+ *    - changed files are compressed on multiple threads,
+ *    - if only a few small files changed, they are appended to the old file, together with a new central directory.
+ *
+ *  Thread safety:
+ *    - openIn, and readFile, can be used from any thread, also at the same time.
+ *      Each call returns its own stream, streams can be used independently of each other and of the package.
+ *    - Everything else (writing, saving, newFileName, referenceFile, ...) may only be done from the main thread.
+ *    - Internally, the file table is only modified by the main thread while holding a lock,
+ *      other threads hold that lock while looking up a file, the main thread can look up files without it.
  *
  *  TODO: maybe support sub packages (a package inside another package)?
  */
@@ -133,11 +141,17 @@ public:
   // --------------------------------------------------- : Managing the inside of the package
 
   /// Open an input stream for a file in the package.
+  /** Can be used from any thread */
   unique_ptr<wxInputStream> openIn(const String& file);
   inline unique_ptr<wxInputStream> openIn(const LocalFileName& file) {
     return openIn(file.fn);
   }
 
+  /// A string that identifies a file and its current contents, for caching things read from it
+  /** The stamp changes when the file is changed. Returns an empty string if the file is not found.
+   *  Can be used from any thread */
+  String fileStamp(const String& file);
+
   /// Open an output stream for a file in the package.
   /// (changes are only committed with save())
   unique_ptr<wxOutputStream> openOut(const String& file);
@@ -162,6 +176,14 @@ public:
   /// If they are to be kept in the package.
   void referenceFile(const String& file);
 
+  /// Find files written since the last save that have the same contents as another file in the package
+  /** When writing names of files (LocalFileName::toStringForWriting) the other file is used instead,
+   *  so the contents are only saved once. The duplicate can still be opened under its own name.
+   */
+  void findDuplicateFiles();
+  /// The file that is saved for the given file, that is the file itself unless it is a duplicate
+  String uniqueFile(const String& file) const;
+
   // --------------------------------------------------- : Managing the inside of the package : Reader/writer
 
   template <typename T>
@@ -214,11 +236,19 @@ public:
   inline const FileInfos& getFileInfos() const { return files; }
   /// When was a file last modified?
   DateTime modificationTime(const pair<String, FileInfo>& fi) const;
+  /// The (uncompressed) size of a file, or -1 if it is unknown
+  wxFileOffset fileSize(const pair<String, FileInfo>& fi) const;
 private:
   /// All files in the package
   FileInfos files;
+  /// Files that have the same contents as another file, which is saved instead, see findDuplicateFiles
+  map<String, String> duplicates;
   /// Filestream/zipstream for reading zip files
   unique_ptr<wxZipInputStream> zipStream;
+  /// Index of the zip file for fast reading, if possible
+  ZipArchiveP zipArchive;
+  /// Lock for changing files, filename and zipArchive, see the thread safety notes above
+  wxMutex lock;
 
   void loadZipStream();
   void openDirectory(bool fast = false);
@@ -228,8 +258,12 @@ private:
   void removeTempFiles(bool remove_unused);
   void clearKeepFlag();
   void saveToZipfile(const String&,   bool remove_unused, bool is_copy);
+  /// Save by appending the changed files to the zip file, returns false if that is not possible
+  bool appendToZipfile(bool remove_unused);
   void saveToDirectory(const String&, bool remove_unused, bool is_copy);
   FileInfos::iterator addFile(const String& file);
+  /// Give the duplicates of a file a copy of its contents, so they don't change when the file is written
+  void detachDuplicates(const String& name);
 
   /// Get an 'absolute filename' for a file in the package.
   /// This file can later be opened from anywhere (other process) using openAbsoluteFile()
@@ -276,6 +310,9 @@ public:
   /** if just_header is true, then the package is not fully parsed.
    */
   void open(const String& package, bool just_header = false);
+  /// Open a package, using a header that was read before instead of reading the data file
+  /** The package is not fully parsed, like open(package, true) */
+  void open(const String& package, const PackageHeader& header);
   /// Ensure the package is fully loaded.
   void loadFully();
   void save();
@@ -297,6 +334,8 @@ protected:
   virtual void validate(Version file_app_version);
   /// What file version should be used for writing files?
   virtual Version fileVersion() const = 0;
+  /// Should the compiled scripts be cached on disk? Only worth it for packages that rarely change
+  virtual bool cacheScripts() const { return false; }
 
   DECLARE_REFLECTION_VIRTUAL();
   friend void after_reading(Packaged& p, Version file_app_version);
@@ -33,30 +33,52 @@ void PackageManager::init() {
                 wxStandardPaths::Get().GetUserDataDir());
 }
 void PackageManager::destroy() {
+  wxMutexLocker locker(lock);
   loaded_packages.clear();
+  local.saveHeaders();
+  global.saveHeaders();
 }
 void PackageManager::reset() {
+  wxMutexLocker locker(lock);
   loaded_packages.clear();
 }
 
+/// Modification time of the data file of a package, which contains the header
+/** The data file of a "x.mse-type" package is called "type" */
+DateTime data_file_modified(const String& filename) {
+  if (wxDirExists(filename)) {
+    String data_file = filename + _("/") + wxFileName(filename).GetExt().Mid(4);
+    if (!wxFileExists(data_file)) return DateTime();
+    return wxFileName(data_file).GetModificationTime();
+  } else if (wxFileExists(filename)) {
+    return wxFileName(filename).GetModificationTime();
+  } else {
+    return DateTime();
+  }
+}
+
 PackagedP PackageManager::openAny(const String& name_, bool just_header) {
   String name = trim(name_);
   if (starts_with(name,_("/"))) name = name.substr(1);
   if (starts_with(name,_(":NO-WARN-DEP:"))) name = name.substr(13);
   // Attempt to load local data first.
   String filename;
+  PackageDirectory* directory = nullptr; // directory the package is in, if any
   if (wxFileName(name).IsRelative()) {
     // local data dir?
     filename = normalize_filename(local.name(name));
+    directory = &local;
     if (!wxFileExists(filename) && !wxDirExists(filename)) {
       // global data dir
       filename = normalize_filename(global.name(name));
+      directory = &global;
     }
   } else { // Absolute filename
     filename = normalize_filename(name);
   }
 
   // Is this package already loaded?
+  wxMutexLocker locker(lock);
   PackagedP& p = loaded_packages[filename];
   if (!p) {
     // load with the right type, based on extension
@@ -70,7 +92,17 @@ PackagedP PackageManager::openAny(const String& name_, bool just_header) {
     else {
       throw PackageError(_("Unrecognized package type: '") + fn.GetExt() + _("'\nwhile trying to open: ") + name);
     }
-    p->open(filename, just_header);
+    // the header might be remembered in the database
+    DateTime modified;
+    if (directory) modified = data_file_modified(filename);
+    PackageHeaderP header;
+    if (just_header && modified.IsValid()) header = directory->findHeader(name, modified);
+    if (header) {
+      p->open(filename, *header);
+    } else {
+      p->open(filename, just_header);
+      if (modified.IsValid()) directory->storeHeader(name, modified, *p);
+    }
   } else if (!just_header) {
     p->loadFully();
   }
@@ -96,29 +128,19 @@ void PackageManager::findMatching(const String& pattern, vector<PackagedP>& out)
 }
 
 pair<unique_ptr<wxInputStream>,Packaged*> PackageManager::openFileFromPackage(Packaged* package, const String& name) {
-  if (!name.empty() && name.GetChar(0) == _('/')) {
-    // absolute name; break name
-    size_t start = name.find_first_not_of(_("/\\"), 1); // allow "//package/name" from incorrect scripts
-    size_t pos   = name.find_first_of(_("/\\"), start);
-    if (start < pos && pos != String::npos) {
-      // open package
-      PackagedP p = openAny(name.substr(start, pos-start));
-      if (package && !is_substr(name,start,_(":NO-WARN-DEP:"))) {
-        package->requireDependency(p.get());
-      }
-      return {p->openIn(name.substr(pos + 1)), p.get()};
-    }
-  } else if (package) {
-    // relative name
-    return {package->openIn(name), package};
-  }
-  throw FileNotFoundError(name, _("No package name specified, use '/package/filename'"));
+  auto [file_package, file] = findFileInPackage(package, name);
+  return {file_package->openIn(file), file_package};
 }
 pair<unique_ptr<wxInputStream>, Packaged*> openFileFromPackage(Packaged* package, const String& name) {
   return package_manager.openFileFromPackage(package, name);
 }
 
 String PackageManager::openFilenameFromPackage(Packaged* package, const String& name) {
+  auto [file_package, file] = findFileInPackage(package, name);
+  return file_package->absoluteFilename() + _("/") + file;
+}
+
+pair<Packaged*,String> PackageManager::findFileInPackage(Packaged* package, const String& name) {
   if (!name.empty() && name.GetChar(0) == _('/')) {
     // absolute name; break name
     size_t start = name.find_first_not_of(_("/\\"), 1); // allow "//package/name" from incorrect scripts
@@ -129,11 +151,11 @@ String PackageManager::openFilenameFromPackage(Packaged* package, const String&
       if (package && !is_substr(name,start,_(":NO-WARN-DEP:"))) {
         package->requireDependency(p.get());
       }
-      return p->absoluteFilename() + _("/") + name.substr(pos + 1);
+      return {p.get(), name.substr(pos + 1)};
     }
   } else if (package) {
     // relative name
-    return package->absoluteFilename() + _("/") + name;
+    return {package, name};
   }
   throw FileNotFoundError(name, _("No package name specified, use '/package/filename'"));
 }
@@ -333,12 +355,53 @@ void PackageDirectory::removeFromDatabase(const String& package_name) {
   packages.resize(j);
 }
 
+bool compare_header_name(const PackageHeaderP& a, const PackageHeaderP& b) {
+  return a->name < b->name;
+}
+
+PackageHeaderP PackageDirectory::findHeader(const String& package_name, const DateTime& modified) {
+  loadDatabase();
+  PackageHeaderP key = make_intrusive<PackageHeader>();
+  key->name = package_name;
+  auto it = lower_bound(headers.begin(), headers.end(), key, compare_header_name);
+  if (it == headers.end() || (*it)->name != package_name) return PackageHeaderP();
+  // the database only stores times to the second
+  if (!(*it)->modified.IsValid() || (*it)->modified.GetTicks() != modified.GetTicks()) return PackageHeaderP();
+  return *it;
+}
+
+void PackageDirectory::storeHeader(const String& package_name, const DateTime& modified, const Packaged& package) {
+  loadDatabase();
+  PackageHeaderP header = make_intrusive<PackageHeader>();
+  header->name     = package_name;
+  header->modified = modified;
+  header->set(package);
+  auto it = lower_bound(headers.begin(), headers.end(), header, compare_header_name);
+  if (it != headers.end() && (*it)->name == package_name) {
+    *it = header;
+  } else {
+    headers.insert(it, header);
+  }
+  headers_changed = true;
+}
+
+void PackageDirectory::saveHeaders() {
+  if (!headers_changed) return;
+  headers_changed = false;
+  // forget packages that were removed
+  headers.erase(remove_if(headers.begin(), headers.end(), [this](const PackageHeaderP& h) { return !exists(h->name); }), headers.end());
+  // the global directory is often not writable, then the headers are read again next time
+  if (wxFileName::IsDirWritable(directory)) saveDatabase();
+}
+
 IMPLEMENT_REFLECTION(PackageDirectory) {
   REFLECT(packages);
+  REFLECT(headers);
 }
 
 void PackageDirectory::loadDatabase() {
-  if (!packages.empty()) return;
+  if (database_loaded) return;
+  database_loaded = true;
   String filename = databaseFile();
   if (wxFileExists(filename)) {
     // packages file not existing is not an error
@@ -347,11 +410,13 @@ void PackageDirectory::loadDatabase() {
     Reader reader(file_stream, nullptr, filename);
     reader.handle_greedy(*this);
     sort(packages.begin(), packages.end(), compare_name);
+    sort(headers.begin(), headers.end(), compare_header_name);
   }
 }
 
 void PackageDirectory::saveDatabase() {
   wxFileOutputStream stream(databaseFile());
+  if (!stream.IsOk()) return; // failure is not an error
   Writer writer(stream, app_version);
   writer.handle(*this);
 }
@@ -408,6 +473,32 @@ bool PackageDirectory::actual_install(const InstallablePackage& package, const S
   return true;
 }
 
+// ----------------------------------------------------------------------------- : PackageHeader
+
+void PackageHeader::set(const Packaged& package) {
+  short_name         = package.short_name;
+  full_name          = package.full_name;
+  icon_filename      = package.icon_filename;
+  position_hint      = package.position_hint;
+  installer_group    = package.installer_group;
+  version            = package.version;
+  compatible_version = package.compatible_version;
+  dependencies       = package.dependencies;
+}
+
+IMPLEMENT_REFLECTION_NO_SCRIPT(PackageHeader) {
+  REFLECT_NO_SCRIPT(name);
+  REFLECT_NO_SCRIPT(modified);
+  REFLECT_NO_SCRIPT(short_name);
+  REFLECT_NO_SCRIPT(full_name);
+  REFLECT_NO_SCRIPT_N("icon", icon_filename);
+  REFLECT_NO_SCRIPT(position_hint);
+  REFLECT_NO_SCRIPT(installer_group);
+  REFLECT_NO_SCRIPT(version);
+  REFLECT_NO_SCRIPT(compatible_version);
+  REFLECT_NO_SCRIPT_N("depends_ons", dependencies); // hack for singular_form
+}
+
 // ----------------------------------------------------------------------------- : PackageVersion
 
 template <> void Writer::handle(const PackageVersion::FileInfo& f) {
@@ -15,6 +15,7 @@
 DECLARE_POINTER_TYPE(Packaged);
 DECLARE_POINTER_TYPE(PackageVersion);
 DECLARE_POINTER_TYPE(InstallablePackage);
+DECLARE_POINTER_TYPE(PackageHeader);
 class PackageDependency;
 
 // ----------------------------------------------------------------------------- : PackageVersion
@@ -54,6 +55,29 @@ IMPLEMENT_REFLECTION_NO_SCRIPT(UpdateData) {
 }
 */
 
+// ----------------------------------------------------------------------------- : PackageHeader
+
+/// The header of an installed package, remembered in the package database
+/** Reading the header of a package means reading its data file,
+ *  with the remembered header that is only needed when the data file has changed.
+ */
+class PackageHeader : public IntrusivePtrBase<PackageHeader> {
+public:
+  PackageHeader() : position_hint(100000) {}
+
+  String   name;      ///< Filename of the package, relative to the package directory
+  DateTime modified;  ///< Modification time of the data file when the header was read
+  String   short_name, full_name, icon_filename, installer_group;
+  int      position_hint;
+  Version  version, compatible_version;
+  vector<PackageDependencyP> dependencies;
+
+  /// Copy the header of a package
+  void set(const Packaged& package);
+
+  DECLARE_REFLECTION();
+};
+
 // ----------------------------------------------------------------------------- : PackageDirectory
 
 /// A directory for packages
@@ -86,12 +110,22 @@ public:
   /// Remove a package from the database
   void removeFromDatabase(const String& package_name);
   
+  /// Find the remembered header of a package, returns nullptr if it is unknown or out of date
+  PackageHeaderP findHeader(const String& package_name, const DateTime& modified);
+  /// Remember the header of a package
+  void storeHeader(const String& package_name, const DateTime& modified, const Packaged& package);
+  /// Save the database if headers were remembered since it was loaded
+  void saveHeaders();
+  
   void loadDatabase();
   void saveDatabase();
 private:
   bool   is_local;
   String directory;
   vector<PackageVersionP> packages; // sorted by name
+  vector<PackageHeaderP>  headers;  // sorted by name
+  bool   database_loaded = false;
+  bool   headers_changed = false;
   
   String databaseFile();
   // Do the actual installation of a package
@@ -105,6 +139,8 @@ private:
 /// Package manager, loads data files from the default data directory.
 /** The PackageManager ensures that each package is only loaded once.
  *  There is a single global instance of the PackageManager, called packages
+ *
+ *  Opening packages and files in packages can be done from any thread.
  */
 class PackageManager {
 public:
@@ -148,6 +184,9 @@ public:
    *  Returns the opened file and the package it is in
    */
   pair<unique_ptr<wxInputStream>,Packaged*> openFileFromPackage(Packaged* package, const String& name);
+  /// Find the package a file is in, and the name of the file in that package
+  /** Names are handled like in openFileFromPackage, but the file is not opened */
+  pair<Packaged*,String> findFileInPackage(Packaged* package, const String& name);
   
   /// Get a filename to open from a package
   /** WARNING: this is a bit of a hack, since not all package types support names in this way.
@@ -181,6 +220,8 @@ public:
 private:
   map<String, PackagedP> loaded_packages;
   PackageDirectory local, global;
+  /// Lock for loaded_packages, held while a package is loaded (which can open other packages)
+  wxMutex lock{wxMUTEX_RECURSIVE};
 };
 
 /// The global PackageManager instance
@@ -12,6 +12,7 @@
 #include <util/error.hpp>
 #include <util/io/package_manager.hpp>
 #include <boost/logic/tribool.hpp>
+#include <wx/mstream.h>
 #undef small
 using boost::tribool;
 
@@ -21,12 +22,31 @@ Reader::Reader(wxInputStream& input, Packaged* package, const String& filename,
   : indent(0), expected_indent(0), state(OUTSIDE)
   , ignore_invalid(ignore_invalid)
   , filename(filename), package(package), line_number(0), previous_line_number(0)
-  , input(input)
+  , input(input), buffer_pos(0), input_eof(false)
 {
+  readFirstLine();
+  handleAppVersion();
+}
+
+Reader::Reader(const UnparsedBlock& block, const Reader& parent)
+  : file_app_version(parent.file_app_version)
+  , indent(0), expected_indent(0), state(OUTSIDE)
+  , ignore_invalid(parent.ignore_invalid)
+  , filename(parent.filename), package(parent.package)
+  , line_number(block.line_number - 1), previous_line_number(block.line_number - 1)
+  , own_input(make_unique<wxMemoryInputStream>(block.text.data(), block.text.size()))
+  , input(*own_input), buffer_pos(0), input_eof(false)
+{
+  readFirstLine();
+}
+
+void Reader::readFirstLine() {
   assert(input.IsOk());
-  eat_utf8_bom(input);
+  // skip the utf-8 byte order mark
+  while (buffer.size() < 3 && fillBuffer()) {}
+  if (buffer.empty()) input_eof = true;
+  if (buffer.size() >= 3 && memcmp(buffer.data(), "\xEF\xBB\xBF", 3) == 0) buffer_pos = 3;
   moveNext();
-  handleAppVersion();
 }
 
 void Reader::handleIgnore(int end_version, const Char* a) {
@@ -58,6 +78,12 @@ void Reader::showWarnings() {
   }
 }
 
+String Reader::takeWarnings() {
+  String taken;
+  swap(taken, warnings);
+  return taken;
+}
+
 bool Reader::enterAnyBlock() {
   if (state == ENTERED) moveNext(); // on the key of the parent block, first move inside it
   if (indent != expected_indent) return false; // not enough indentation
@@ -78,6 +104,16 @@ bool Reader::enterBlock(const Char* name) {
   }
 }
 
+void Reader::handleUnparsed(const Char* name, vector<UnparsedBlock>& blocks) {
+  while (enterBlock(name)) {
+    // we are on the line with the key, the lines of the block come next
+    blocks.emplace_back();
+    blocks.back().line_number = line_number + 1;
+    readUnparsedLines(blocks.back().text);
+    exitBlock();
+  }
+}
+
 void Reader::exitBlock() {
   assert(expected_indent > 0);
   expected_indent -= 1;
@@ -98,11 +134,11 @@ void Reader::moveNext() {
   key.clear();
   indent = -1; // if no line is read it never has the expected indentation
   // repeat until we have a good line
-  while (key.empty() && !input.Eof()) {
+  while (key.empty() && !input_eof) {
     readLine();
   }
   // did we reach the end of the file?
-  if (key.empty() && input.Eof()) {
+  if (key.empty() && input_eof) {
     line_number += 1;
     indent = -1;
   }
@@ -185,46 +221,171 @@ String read_utf8_line(wxInputStream& input, bool until_eof) {
   return wxString::FromUTF8(buffer.get(), buffer.size());
 }
 
+/// Read the input in blocks of this size
+const size_t READ_BLOCK_SIZE = 64 * 1024;
+
+bool Reader::fillBuffer() {
+  if (input.Eof()) return false;
+  // drop the data that was already handled
+  buffer.erase(buffer.begin(), buffer.begin() + buffer_pos);
+  buffer_pos = 0;
+  size_t size = buffer.size();
+  buffer.resize(size + READ_BLOCK_SIZE);
+  input.Read(buffer.data() + size, READ_BLOCK_SIZE);
+  buffer.resize(size + input.LastRead());
+  return input.LastRead() > 0;
+}
+
+void Reader::readRawLine(const char*& text, size_t& size) {
+  // find the end of the line, reading more data if needed
+  size = 0;
+  while (true) {
+    const char* data = buffer.data() + buffer_pos;
+    size_t available = buffer.size() - buffer_pos;
+    while (size < available && data[size] != '\n' && data[size] != '\r') ++size;
+    if (size < available) break;
+    if (!fillBuffer()) {
+      input_eof = true;
+      break;
+    }
+  }
+  // skip the line ending: \n, \r\n or \r
+  size_t line_ending = 0;
+  if (buffer_pos + size < buffer.size()) {
+    line_ending = 1;
+    if (buffer[buffer_pos + size] == '\r') {
+      if (buffer_pos + size + 1 == buffer.size() && !fillBuffer()) {
+        input_eof = true;
+      } else if (buffer[buffer_pos + size + 1] == '\n') {
+        line_ending = 2;
+      }
+    }
+  }
+  text = buffer.data() + buffer_pos;
+  buffer_pos += size + line_ending;
+}
+
+String decode_utf8(const char* text, size_t size);
+
+void Reader::readUnparsedLines(std::string& text) {
+  while (!input_eof) {
+    const char* line_text;
+    size_t size;
+    readRawLine(line_text, size);
+    size_t tabs = 0;
+    while (tabs < size && line_text[tabs] == '\t') ++tabs;
+    size_t content = tabs;
+    while (content < size && (line_text[content] == ' ' || line_text[content] == '\t')) ++content;
+    bool empty_or_comment = content == size || line_text[tabs] == '#';
+    // like readLine: 8 spaces after the tabs count as a tab
+    size_t indent = tabs, space_end = tabs;
+    if (!ignore_invalid && !empty_or_comment) {
+      while (indent < (size_t)expected_indent && space_end + 8 <= size && memcmp(line_text + space_end, "        ", 8) == 0) {
+        space_end += 8;
+        indent += 1;
+      }
+    }
+    if (!empty_or_comment && indent < (size_t)expected_indent) {
+      // this line is after the block, leave it for readLine
+      buffer_pos = line_text - buffer.data();
+      input_eof = false;
+      return;
+    }
+    line_number += 1;
+    if (space_end > tabs) {
+      // the spaces are stripped below, so the reader of the block won't see them
+      const char* colon = (const char*)memchr(line_text + tabs, ':', size - tabs);
+      size_t key_end = colon ? colon - line_text : size;
+      warning(_("key: '") + decode_utf8(line_text + tabs, key_end - tabs) + _("' starts with a space; only use TABs for indentation!"), 0, false);
+    }
+    size_t strip = tabs >= (size_t)expected_indent ? (size_t)expected_indent : space_end;
+    text.append(line_text + strip, size - strip);
+    text += '\n';
+  }
+}
+
+/// Decode UTF-8, as opposed to wx functions, this one actually reports errors
+String decode_utf8(const char* text, size_t size) {
+  if (size == 0) return String();
+  String str = String::FromUTF8(text, size);
+  if (str.empty()) throw ParseError(_("Invalid UTF-8 sequence"));
+  return str;
+}
+
+inline bool is_ascii_space(char c) {
+  return c == ' ' || c == '\t' || c == '\v' || c == '\f';
+}
+
+/// Canonical names of the keys used in files, by their text in the file
+/** Files use the same keys over and over, this way they are decoded and converted only once per thread */
+thread_local unordered_map<std::string, String> key_names;
+thread_local std::string key_text;
+
+/// Turn the text of a key into its canonical name, trim(canonical_name_form(key))
+const String& canonical_key(const char* text, size_t size) {
+  key_text.assign(text, size);
+  auto it = key_names.find(key_text);
+  if (it != key_names.end()) return it->second;
+  if (key_names.size() > 10000) key_names.clear(); // a file with lots of keys in a map, don't keep them forever
+  return key_names[key_text] = canonical_name_form(trim(decode_utf8(text, size)));
+}
+
 void Reader::readLine(bool in_string) {
   line_number += 1;
   // We have to do our own line reading, because wxTextInputStream is insane
+  const char* text;
+  size_t size;
+  readRawLine(text, size);
   try {
-    line = read_utf8_line(input);
-  } catch (const ParseError& e) {
-    throw ParseError(e.what() + String(_(" on line ")) << line_number);
-  }
-  // read indentation
-  indent = 0;
-  while ((UInt)indent < line.size() && line.GetChar(indent) == _('\t')) {
-    indent += 1;
-  }
-  // read key / value
-  if (line.find_first_not_of(_(" \t")) == String::npos || line.GetChar(indent) == _('#')) {
-    // empty line or comment
-    key.clear();
-    return;
-  }
-  size_t pos = line.find_first_of(_(':'), indent);
-  key = line.substr(indent, pos - indent);
-  if (!ignore_invalid && !in_string && starts_with(key, _(" "))) {
-    warning(_("key: '") + key + _("' starts with a space; only use TABs for indentation!"), 0, false);
-    // try to fix up: 8 spaces is a tab
-    while (starts_with(key, _("        "))) {
-      key = key.substr(8);
+    if (in_string) line = decode_utf8(text, size);
+    // read indentation
+    indent = 0;
+    while ((size_t)indent < size && text[indent] == '\t') {
       indent += 1;
     }
-  }
-  key = canonical_name_form(trim(key));
-  if (pos == String::npos) {
-    if (!ignore_invalid && !in_string) {
-      warning(_("Missing ':' "), 0, false);
+    // read key / value
+    size_t content = indent;
+    while (content < size && (text[content] == ' ' || text[content] == '\t')) {
+      content += 1;
     }
-    value.clear();
-  } else {
-    value = trim_left(substr(line, pos+1));
-  }
-  if (key.empty() && pos!=String::npos) {
-    key = _(" "); // we don't want an empty key if there was a colon
+    if (content == size || text[indent] == '#') {
+      // empty line or comment
+      key.clear();
+      return;
+    }
+    const char* colon = (const char*)memchr(text + indent, ':', size - indent);
+    size_t key_begin = indent;
+    size_t key_end = colon ? colon - text : size;
+    if (!ignore_invalid && !in_string && key_begin < key_end && text[key_begin] == ' ') {
+      warning(_("key: '") + decode_utf8(text + key_begin, key_end - key_begin) + _("' starts with a space; only use TABs for indentation!"), 0, false);
+      // try to fix up: 8 spaces is a tab
+      while (key_end - key_begin >= 8 && memcmp(text + key_begin, "        ", 8) == 0) {
+        key_begin += 8;
+        indent += 1;
+      }
+    }
+    key = canonical_key(text + key_begin, key_end - key_begin);
+    if (!colon) {
+      if (!ignore_invalid && !in_string) {
+        warning(_("Missing ':' "), 0, false);
+      }
+      value.clear();
+    } else {
+      size_t value_begin = key_end + 1;
+      while (value_begin < size && is_ascii_space(text[value_begin])) {
+        value_begin += 1;
+      }
+      value = decode_utf8(text + value_begin, size - value_begin);
+      // other whitespace characters
+      size_t spaces = 0;
+      while (spaces < value.size() && isSpace(value.GetChar(spaces))) spaces += 1;
+      if (spaces) value.erase(0, spaces);
+    }
+    if (key.empty() && colon) {
+      key = _(" "); // we don't want an empty key if there was a colon
+    }
+  } catch (const ParseError& e) {
+    throw ParseError(e.what() + String(_(" on line ")) << line_number);
   }
 }
 
@@ -264,7 +425,7 @@ const String& Reader::getValue() {
     // read all lines that are indented enough
     readLine(true);
     previous_line_number = line_number;
-    while (indent >= expected_indent && !input.Eof()) {
+    while (indent >= expected_indent && !input_eof) {
       previous_value.resize(previous_value.size() + pending_newlines, _('\n'));
       pending_newlines = 0;
       previous_value += line.substr(expected_indent); // strip expected indent
@@ -272,15 +433,15 @@ const String& Reader::getValue() {
         readLine(true);
         pending_newlines++;
         // skip empty lines that are not indented enough
-      } while(trim(line).empty() && indent < expected_indent && !input.Eof());
+      } while(trim(line).empty() && indent < expected_indent && !input_eof);
     }
     // moveNext(), but without the initial readLine()
     state = HANDLED;
-    while (key.empty() && !input.Eof()) {
+    while (key.empty() && !input_eof) {
       readLine();
     }
     // did we reach the end of the file?
-    if (key.empty() && input.Eof()) {
+    if (key.empty() && input_eof) {
       line_number += 1;
       indent = -1;
     }
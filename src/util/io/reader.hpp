@@ -36,6 +36,17 @@ public:
    */
   Reader(wxInputStream& input, Packaged* package = nullptr, const String& filename = wxEmptyString, bool ignore_invalid = false);
   
+  /// A block that was read without parsing it, see handleUnparsed
+  struct UnparsedBlock {
+    std::string text;  ///< The lines of the block in UTF-8, without the indentation of the block
+    int line_number;   ///< Line number of the first line, for error messages
+  };
+  /// Construct a reader for a block that was read with handleUnparsed
+  /** Uses the package, filename and format version of the parent.
+   *  The parent is only read from, so multiple threads can each read their own blocks.
+   */
+  Reader(const UnparsedBlock& block, const Reader& parent);
+  
   ~Reader() { showWarnings(); }
   
   /// Tell the reflection code we are reading
@@ -56,6 +67,10 @@ public:
   void warning(const String& msg, int line_number_delta = 0, bool warn_on_previous_line = true);
   /// Show all warning messages, but continue reading
   void showWarnings();
+  /// Take the warning messages, so they are not shown by this reader, but can be added to another one
+  String takeWarnings();
+  /// Add warning messages taken from another reader, e.g. one for an UnparsedBlock
+  inline void addWarnings(const String& more) { warnings += more; }
   
   // --------------------------------------------------- : Handling objects
   /// Handle an object that can read as much as it can eat
@@ -88,6 +103,11 @@ public:
   /// Reads a vector from the input stream
   template <typename T>
   void handle(const Char* name, vector<T>& vector);
+  /// Read all blocks with the given key, without parsing them
+  /** The text of the blocks is not even decoded, so this is much faster than reading them.
+   *  Each block can be parsed later by a Reader of its own.
+   */
+  void handleUnparsed(const Char* name, vector<UnparsedBlock>& blocks);
   
   /// Reads an object of type T from the input stream
   template <typename T> void handle(T&);
@@ -146,13 +166,22 @@ private:
   int line_number;
   /// Line number of the previous_line
   int previous_line_number;
+  /// Input stream owned by this reader, if any
+  unique_ptr<wxInputStream> own_input;
   /// Input stream we are reading from
-  wxBufferedInputStream input;
+  wxInputStream& input;
+  /// Data read from the input, the part before buffer_pos has been handled
+  vector<char> buffer;
+  size_t buffer_pos;
+  /// Have we tried to read past the end of the input? (like wxInputStream::Eof)
+  bool input_eof;
   /// Accumulated warning messages
   String warnings;
   
   // --------------------------------------------------- : Reading the stream
   
+  /// Skip the byte order mark and read the first line
+  void readFirstLine();
   /// Is there a block with the given key under the current cursor? if so, enter it
   bool enterBlock(const Char* name);
   /// Enter any block, no matter what the key
@@ -163,7 +192,14 @@ private:
   /// Move to the next non empty line
   void moveNext();
   /// Reads the next line from the input, and stores it in line/key/value/indent
+  /** line is only set when in_string, it is not needed otherwise */
   void readLine(bool in_string = false);
+  /// Get the next line from the buffer, without the line ending, the data is valid until the next call
+  void readRawLine(const char*& text, size_t& size);
+  /// Read more data into the buffer, returns false if there is no more data
+  bool fillBuffer();
+  /// Read the lines of the current block as they are, up to the first line that is not indented enough
+  void readUnparsedLines(std::string& text);
   
   /// Return the value on the current line
   const String& getValue();
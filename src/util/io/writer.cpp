@@ -17,16 +17,54 @@ using boost::tribool;
 
 // ----------------------------------------------------------------------------- : Writer
 
+/// Write the buffer to the stream when it gets this large
+const size_t WRITE_BLOCK_SIZE = 64 * 1024;
+
 Writer::Writer(OutputStream& output, Version file_app_version)
   : indentation(0)
   , output(output)
-  , stream(output, wxEOL_UNIX, wxMBConvUTF8())
 {
-  stream.WriteString(BYTE_ORDER_MARK);
+  buffer.reserve(WRITE_BLOCK_SIZE + 1024);
+  buffer += "\xEF\xBB\xBF"; // byte order mark
   handle(_("mse_version"), file_app_version);
 }
 
+Writer::~Writer() {
+  flush();
+}
 
+void Writer::flush() {
+  if (!buffer.empty()) {
+    output.Write(buffer.data(), buffer.size());
+    buffer.clear(); // keeps the memory
+  }
+}
+
+void Writer::write(const wchar_t* text, size_t size) {
+  for (size_t i = 0 ; i < size ; ++i) {
+    UInt c = text[i];
+    if (c < 0x80) {
+      buffer += (char)c;
+      continue;
+    }
+    if (c >= 0xD800 && c < 0xDC00 && i + 1 < size && text[i+1] >= 0xDC00 && text[i+1] < 0xE000) {
+      // surrogate pair, wchar_t is UTF-16 on windows
+      c = 0x10000 + ((c - 0xD800) << 10) + (text[i+1] - 0xDC00);
+      i += 1;
+    }
+    if (c < 0x800) {
+      buffer += (char)(0xC0 | (c >> 6));
+    } else if (c < 0x10000) {
+      buffer += (char)(0xE0 | (c >> 12));
+      buffer += (char)(0x80 | ((c >> 6) & 0x3F));
+    } else {
+      buffer += (char)(0xF0 | (c >> 18));
+      buffer += (char)(0x80 | ((c >> 12) & 0x3F));
+      buffer += (char)(0x80 | ((c >> 6) & 0x3F));
+    }
+    buffer += (char)(0x80 | (c & 0x3F));
+  }
+}
 
 void Writer::enterBlock(const Char* name) {
   // don't write the key yet
@@ -49,19 +87,17 @@ void Writer::writePending() {
   for (size_t i = 0 ; i < pending_opened.size() ; ++i) {
     if (i > 0) {
       // before entering a sub-block, write a colon after the parent's name
-      stream.WriteString(_(":\n"));
+      buffer += ":\n";
     }
     indentation += 1;
     writeIndentation();
-    writeUTF8(stream, pending_opened[i]);
+    write(pending_opened[i], wcslen(pending_opened[i]));
   }
   pending_opened.clear();
 }
 
 void Writer::writeIndentation() {
-  for(int i = 1 ; i < indentation ; ++i) {
-    stream.PutChar(_('\t'));
-  }
+  if (indentation > 1) buffer.append(indentation - 1, '\t');
 }
 
 // ----------------------------------------------------------------------------- : Handling basic types
@@ -74,18 +110,19 @@ void Writer::handle(const String& value) {
   // write indentation and key
   if (value.find_first_of(_('\n')) != String::npos || (!value.empty() && isSpace(value.GetChar(0)))) {
     // multiline string, or contains leading whitespace
-    stream.WriteString(_(":\n"));
+    buffer += ":\n";
     indentation += 1;
     // split lines, and write each line
+    const wchar_t* text = value.wc_str();
     size_t start = 0, end, size = value.size();
     while (start < size) {
       end = value.find_first_of(_("\n\r"), start); // until end of line
       // write the line
       writeIndentation();
-      writeUTF8(stream, value.substr(start, end - start));
+      write(text + start, min(end, size) - start);
       // Skip \r and \n
       if (end == String::npos) break;
-      stream.PutChar(_('\n'));
+      buffer += '\n';
       start = end + 1;
       if (start < size) {
         Char c1 = value.GetChar(start - 1);
@@ -96,10 +133,11 @@ void Writer::handle(const String& value) {
     }
     indentation -= 1;
   } else {
-    stream.WriteString(_(": "));
-    writeUTF8(stream, value);
+    buffer += ": ";
+    write(value);
   }
-  stream.PutChar(_('\n'));
+  buffer += '\n';
+  if (buffer.size() >= WRITE_BLOCK_SIZE) flush();
 }
 
 template <> void Writer::handle(const int& value) {
@@ -19,10 +19,17 @@ DECLARE_POINTER_TYPE(StyleSheet);
 // ----------------------------------------------------------------------------- : Writer
 
 /// The Writer can be used for writing (serializing) objects
+/** The output is encoded as UTF-8 into a buffer, which is written to the stream in large blocks.
+ *  The buffer is flushed when the writer is destroyed, use flush() to read the stream before that.
+ */
 class Writer {
 public:
   /// Construct a writer that writes to the given output stream
   Writer(OutputStream& output, Version file_app_version);
+  ~Writer();
+  
+  /// Write all buffered output to the stream
+  void flush();
   
   /// Tell the reflection code we are not reading
   static constexpr bool isReading = false;
@@ -79,8 +86,8 @@ private:
   
   /// Output stream we are writing to
   OutputStream& output;
-  /// Text stream wrapping the output stream
-  wxTextOutputStream stream;
+  /// UTF-8 encoded output that has not been written to the stream yet, reused after flushing
+  std::string buffer;
   
   // --------------------------------------------------- : Writing to the stream
   
@@ -93,6 +100,9 @@ private:
   void writePending();
   /// Output some taps to represent the indentation level
   void writeIndentation();
+  /// Write text to the buffer, encoded as UTF-8
+  void write(const wchar_t* text, size_t size);
+  inline void write(const String& text) { write(text.wc_str(), text.size()); }
 };
 
 // ----------------------------------------------------------------------------- : Container types
@@ -0,0 +1,523 @@
+//+----------------------------------------------------------------------------+
+//| Description:  Magic Set Editor - Program to make Magic (tm) cards          |
+//| Copyright:    (C) Twan van Laarhoven and the other MSE developers          |
+//| License:      GNU General Public License 2 or later (see file COPYING)     |
+//+----------------------------------------------------------------------------+
+
+// ----------------------------------------------------------------------------- : Includes
+
+#include <util/prec.hpp>
+#include <util/io/zip_archive.hpp>
+#include <util/file_utils.hpp>
+#include <wx/mstream.h>
+#include <wx/zstream.h>
+#include <wx/wfstream.h>
+#include <wx/zipstrm.h>
+#include <wx/thread.h>
+#include <atomic>
+#ifdef __WXMSW__
+  #include <windows.h>
+#else
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <fcntl.h>
+  #include <unistd.h>
+#endif
+
+// ----------------------------------------------------------------------------- : Zip format
+
+// See the PKWARE APPNOTE for the details of the format.
+// All numbers are little endian.
+
+const UInt ZIP_LOCAL_HEADER_SIG   = 0x04034b50;
+const UInt ZIP_CENTRAL_HEADER_SIG = 0x02014b50;
+const UInt ZIP_END_RECORD_SIG     = 0x06054b50;
+
+const size_t ZIP_LOCAL_HEADER_SIZE   = 30;
+const size_t ZIP_CENTRAL_HEADER_SIZE = 46;
+const size_t ZIP_END_RECORD_SIZE     = 22;
+const size_t ZIP_MAX_COMMENT_SIZE    = 0xFFFF;
+
+const size_t ZIP_DATA_DESCRIPTOR_SIZE = 16;
+const size_t ZIP_MAX_SIZE            = 0xFFFFFFFE; // larger sizes and offsets need zip64
+const UInt   ZIP_MAX_COUNT           = 0xFFFE;
+
+const UInt ZIP_VERSION         = 20; // version 2.0: deflate and directories
+
+const UInt ZIP_METHOD_STORED   = 0;
+const UInt ZIP_METHOD_DEFLATED = 8;
+
+const UInt ZIP_FLAG_ENCRYPTED       = 0x0001;
+const UInt ZIP_FLAG_DATA_DESCRIPTOR = 0x0008;
+const UInt ZIP_FLAG_UTF8            = 0x0800;
+
+inline UInt read_u16(const Byte* p) {
+  return p[0] | p[1] << 8;
+}
+inline UInt read_u32(const Byte* p) {
+  return p[0] | p[1] << 8 | p[2] << 16 | (UInt)p[3] << 24;
+}
+inline void write_u16(vector<Byte>& out, UInt x) {
+  out.push_back(Byte(x));
+  out.push_back(Byte(x >> 8));
+}
+inline void write_u32(vector<Byte>& out, UInt x) {
+  write_u16(out, x & 0xFFFF);
+  write_u16(out, x >> 16);
+}
+
+// ----------------------------------------------------------------------------- : MappedFile
+
+/// A read only view of a whole file in memory
+/** Uses a memory mapping when possible, otherwise the file is read into a buffer */
+class ZipArchive::MappedFile {
+public:
+  MappedFile() : data(nullptr), size(0)
+    #ifdef __WXMSW__
+      , file(INVALID_HANDLE_VALUE), mapping(nullptr)
+    #else
+      , mapped(false)
+    #endif
+  {}
+  ~MappedFile() {
+    #ifdef __WXMSW__
+      if (mapping) {
+        UnmapViewOfFile(data);
+        CloseHandle(mapping);
+      }
+      if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+    #else
+      if (mapped) munmap(const_cast<Byte*>(data), size);
+    #endif
+  }
+
+  bool open(const String& filename) {
+    #ifdef __WXMSW__
+      // allow the file to be renamed/deleted/appended to while it is open, as happens when saving
+      file = CreateFileW(filename.wc_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+      if (file == INVALID_HANDLE_VALUE) return false;
+      LARGE_INTEGER file_size;
+      if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0) return false;
+      size = (size_t)file_size.QuadPart;
+      mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+      if (mapping) {
+        data = (const Byte*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        if (data) return true;
+        CloseHandle(mapping);
+        mapping = nullptr;
+      }
+    #else
+      int fd = ::open(filename.fn_str(), O_RDONLY);
+      if (fd < 0) return false;
+      struct stat st;
+      if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        close(fd);
+        return false;
+      }
+      size = (size_t)st.st_size;
+      void* p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+      close(fd); // the mapping stays valid
+      if (p != MAP_FAILED) {
+        data = (const Byte*)p;
+        mapped = true;
+        return true;
+      }
+    #endif
+    // mapping failed, read the file instead
+    wxFileInputStream stream(filename);
+    if (!stream.IsOk()) return false;
+    buffer.resize(size);
+    stream.Read(buffer.data(), size);
+    if (stream.LastRead() != size) return false;
+    data = buffer.data();
+    return true;
+  }
+
+  /// Use data that is already in memory
+  void adopt(vector<Byte>& in) {
+    buffer.swap(in);
+    data = buffer.data();
+    size = buffer.size();
+  }
+
+  const Byte* data;
+  size_t      size;
+private:
+  vector<Byte> buffer;
+  #ifdef __WXMSW__
+    HANDLE file, mapping;
+  #else
+    bool mapped;
+  #endif
+};
+
+// ----------------------------------------------------------------------------- : Streams
+
+/// A stream over the data of a file in the archive, keeps the archive alive
+/** The data is not copied */
+class ZipStoredInputStream : public wxMemoryInputStream {
+public:
+  ZipStoredInputStream(const ZipArchiveP& archive, const Byte* data, size_t size)
+    : wxMemoryInputStream(data, size)
+    , archive(archive)
+  {}
+private:
+  ZipArchiveP archive;
+};
+
+/// Decompressing stream over the data of a deflated file in the archive
+class ZipDeflatedInputStream : public wxZlibInputStream {
+public:
+  ZipDeflatedInputStream(const ZipArchiveP& archive, const Byte* data, size_t compressed_size, size_t size)
+    : wxZlibInputStream(new wxMemoryInputStream(data, compressed_size), wxZLIB_NO_HEADER)
+    , archive(archive)
+    , size(size)
+  {}
+  wxFileOffset GetLength() const override {
+    return size;
+  }
+private:
+  ZipArchiveP archive;
+  size_t      size;
+};
+
+// ----------------------------------------------------------------------------- : ZipArchive
+
+ZipArchive::ZipArchive() {}
+ZipArchive::~ZipArchive() {}
+
+ZipArchiveP ZipArchive::open(const String& filename) {
+  ZipArchiveP archive(new ZipArchive);
+  archive->file = make_unique<MappedFile>();
+  if (!archive->file->open(filename)) return ZipArchiveP();
+  if (!archive->readCentralDirectory()) return ZipArchiveP();
+  return archive;
+}
+
+ZipArchiveP ZipArchive::compress(const String& name, wxInputStream& in) {
+  // let wxZipOutputStream do the compressing, then index the result like any other archive
+  wxMemoryOutputStream buffer;
+  {
+    wxZipOutputStream zip(buffer);
+    if (!zip.PutNextEntry(name)) return ZipArchiveP();
+    zip.Write(in);
+    if (in.GetLastError() != wxSTREAM_NO_ERROR && in.GetLastError() != wxSTREAM_EOF) return ZipArchiveP();
+    if (!zip.Close()) return ZipArchiveP();
+  }
+  vector<Byte> data(buffer.GetSize());
+  buffer.CopyTo(data.data(), data.size());
+  ZipArchiveP archive(new ZipArchive);
+  archive->file = make_unique<MappedFile>();
+  archive->file->adopt(data);
+  if (!archive->readCentralDirectory()) return ZipArchiveP();
+  return archive;
+}
+
+bool ZipArchive::readCentralDirectory() {
+  const Byte* data = file->data;
+  size_t size = file->size;
+  if (size < ZIP_END_RECORD_SIZE) return false;
+  // find the end of central directory record, it is followed by a comment of unknown size
+  size_t end = size - ZIP_END_RECORD_SIZE;
+  size_t stop = end > ZIP_MAX_COMMENT_SIZE ? end - ZIP_MAX_COMMENT_SIZE : 0;
+  for (size_t pos = end + 1 ; pos-- > stop ; ) {
+    if (read_u32(data + pos) == ZIP_END_RECORD_SIG && readCentralDirectory(pos)) {
+      intact_size = size;
+      return true;
+    }
+  }
+  // no intact end record, the end of the file could be left over from an interrupted append,
+  // then the end record before it still describes the old archive.
+  // That record is directly followed by what was appended: a local header, or a central header if no files changed.
+  // Other data that looks like an end record (e.g. in a stored file) is only used if all its local headers check out.
+  for (size_t pos = stop ; pos-- > 0 ; ) {
+    if (read_u32(data + pos) != ZIP_END_RECORD_SIG) continue;
+    size_t next = pos + ZIP_END_RECORD_SIZE + read_u16(data + pos + 20); // after the comment
+    if (next > size || size - next < 4) continue;
+    UInt next_sig = read_u32(data + next);
+    if (next_sig != ZIP_LOCAL_HEADER_SIG && next_sig != ZIP_CENTRAL_HEADER_SIG) continue;
+    if (readCentralDirectory(pos) && checkLocalHeaders(read_u32(data + pos + 16))) {
+      intact_size = next;
+      return true;
+    }
+  }
+  entries.clear();
+  return false;
+}
+
+bool ZipArchive::checkLocalHeaders(size_t cd_offset) const {
+  FOR_EACH_CONST(e, entries) {
+    const Entry& entry = e.second;
+    if (entry.header_offset > cd_offset || cd_offset - entry.header_offset < entry.stored_size) return false;
+    if (!entryData(entry)) return false;
+  }
+  return true;
+}
+
+bool ZipArchive::readCentralDirectory(size_t end) {
+  const Byte* data = file->data;
+  const Byte* record = data + end;
+  UInt disk        = read_u16(record + 4);
+  UInt cd_disk     = read_u16(record + 6);
+  UInt count       = read_u16(record + 10);
+  size_t cd_size   = read_u32(record + 12);
+  size_t cd_offset = read_u32(record + 16);
+  if (disk != 0 || cd_disk != 0) return false; // multi disk
+  if (count == 0xFFFF || cd_size == 0xFFFFFFFF || cd_offset == 0xFFFFFFFF) return false; // zip64
+  if (cd_offset > end || cd_size != end - cd_offset) return false; // the directory comes right before the end record
+  // read the central directory
+  Entries entries;
+  entries.reserve(count);
+  const Byte* p   = data + cd_offset;
+  const Byte* cde = p + cd_size;
+  for (UInt i = 0 ; i < count ; ++i) {
+    if (cde - p < (ptrdiff_t)ZIP_CENTRAL_HEADER_SIZE || read_u32(p) != ZIP_CENTRAL_HEADER_SIG) return false;
+    Entry entry;
+    entry.flags           = read_u16(p + 8);
+    entry.method          = read_u16(p + 10);
+    entry.dos_time        = read_u16(p + 14) << 16 | read_u16(p + 12);
+    entry.crc             = read_u32(p + 16);
+    entry.compressed_size = read_u32(p + 20);
+    entry.size            = read_u32(p + 24);
+    size_t name_size      = read_u16(p + 28);
+    size_t extra_size     = read_u16(p + 30);
+    size_t comment_size   = read_u16(p + 32);
+    entry.header_offset   = read_u32(p + 42);
+    if (entry.compressed_size == 0xFFFFFFFF || entry.size == 0xFFFFFFFF || entry.header_offset == 0xFFFFFFFF) return false; // zip64
+    size_t total = ZIP_CENTRAL_HEADER_SIZE + name_size + extra_size + comment_size;
+    if ((size_t)(cde - p) < total) return false;
+    entry.stored_size     = ZIP_LOCAL_HEADER_SIZE + name_size + extra_size + entry.compressed_size
+                          + (entry.flags & ZIP_FLAG_DATA_DESCRIPTOR ? ZIP_DATA_DESCRIPTOR_SIZE : 0);
+    // name, the same conversion as wxZipInputStream uses
+    const char* name = (const char*)(p + ZIP_CENTRAL_HEADER_SIZE);
+    String name_str = (entry.flags & ZIP_FLAG_UTF8)
+                    ? String::FromUTF8(name, name_size)
+                    : String(name, wxConvLocal, name_size);
+    entries[normalize_internal_filename(name_str)] = entry;
+    p += total;
+  }
+  this->entries.swap(entries);
+  return true;
+}
+
+size_t ZipArchive::fileSize() const {
+  return file->size;
+}
+
+bool ZipArchive::truncateFile(const String& filename, size_t size) {
+  #ifdef __WXMSW__
+    HANDLE file = CreateFileW(filename.wc_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) return false;
+    LARGE_INTEGER pos;
+    pos.QuadPart = (LONGLONG)size;
+    bool ok = SetFilePointerEx(file, pos, nullptr, FILE_BEGIN) && SetEndOfFile(file);
+    CloseHandle(file);
+    return ok;
+  #else
+    return ::truncate(filename.fn_str(), (off_t)size) == 0;
+  #endif
+}
+
+const ZipArchive::Entry* ZipArchive::find(const String& name) const {
+  auto it = entries.find(name);
+  return it == entries.end() ? nullptr : &it->second;
+}
+
+const Byte* ZipArchive::entryData(const Entry& entry) const {
+  // the local header has its own (possibly different) name and extra field sizes
+  size_t size = file->size;
+  if (entry.header_offset > size || size - entry.header_offset < ZIP_LOCAL_HEADER_SIZE) return nullptr;
+  const Byte* header = file->data + entry.header_offset;
+  if (read_u32(header) != ZIP_LOCAL_HEADER_SIG) return nullptr;
+  size_t offset = entry.header_offset + ZIP_LOCAL_HEADER_SIZE + read_u16(header + 26) + read_u16(header + 28);
+  if (offset > size || size - offset < entry.compressed_size) return nullptr;
+  return file->data + offset;
+}
+
+unique_ptr<wxInputStream> ZipArchive::openIn(const String& name) {
+  const Entry* entry = find(name);
+  if (!entry || (entry->flags & ZIP_FLAG_ENCRYPTED)) return nullptr;
+  const Byte* data = entryData(*entry);
+  if (!data) return nullptr;
+  if (entry->method == ZIP_METHOD_STORED) {
+    return make_unique<ZipStoredInputStream>(ZipArchiveP(this), data, entry->compressed_size);
+  } else if (entry->method == ZIP_METHOD_DEFLATED) {
+    return make_unique<ZipDeflatedInputStream>(ZipArchiveP(this), data, entry->compressed_size, entry->size);
+  } else {
+    return nullptr; // let wxZipInputStream deal with other compression methods
+  }
+}
+
+bool ZipArchive::rawData(const String& name, ZipData& out) {
+  const Entry* entry = find(name);
+  if (!entry) return false;
+  const Byte* data = entryData(*entry);
+  if (!data) return false;
+  out.name    = name;
+  out.info    = *entry;
+  out.data    = data;
+  out.archive = ZipArchiveP(this);
+  out.input.reset();
+  return true;
+}
+
+// ----------------------------------------------------------------------------- : ZipData
+
+/// Only start threads if there is at least this much data to compress
+const wxFileOffset ZIP_PARALLEL_MIN_SIZE = 256 * 1024;
+
+/// Compress files, taking the next file to compress from a shared counter
+void compress_files(vector<ZipData*>& files, std::atomic<size_t>& next, std::atomic<bool>& ok) {
+  for (size_t i = next++ ; i < files.size() ; i = next++) {
+    if (!files[i]->compress()) ok = false;
+  }
+}
+
+class ZipCompressThread : public wxThread {
+public:
+  ZipCompressThread(vector<ZipData*>& files, std::atomic<size_t>& next, std::atomic<bool>& ok)
+    : wxThread(wxTHREAD_JOINABLE)
+    , files(files), next(next), ok(ok)
+  {}
+protected:
+  ExitCode Entry() override {
+    compress_files(files, next, ok);
+    return 0;
+  }
+private:
+  vector<ZipData*>& files;
+  std::atomic<size_t>& next;
+  std::atomic<bool>& ok;
+};
+
+bool ZipData::compressAll(vector<ZipData>& files) {
+  vector<ZipData*> todo;
+  wxFileOffset todo_size = 0;
+  FOR_EACH(f, files) {
+    if (!f.input) continue;
+    todo.push_back(&f);
+    todo_size += max((wxFileOffset)0, f.input->GetLength());
+  }
+  std::atomic<size_t> next(0);
+  std::atomic<bool> ok(true);
+  // starting threads is only worth it for larger amounts of data
+  int thread_count = todo_size < ZIP_PARALLEL_MIN_SIZE ? 1 : min((int)todo.size(), wxThread::GetCPUCount());
+  vector<unique_ptr<ZipCompressThread>> threads;
+  for (int t = 1 ; t < thread_count ; ++t) {
+    auto thread = make_unique<ZipCompressThread>(todo, next, ok);
+    if (thread->Run() == wxTHREAD_NO_ERROR) threads.push_back(move(thread));
+  }
+  // this thread helps, and does everything if no threads could be started
+  compress_files(todo, next, ok);
+  FOR_EACH(t, threads) t->Wait();
+  return ok;
+}
+
+bool ZipData::compress() {
+  if (!input) return data != nullptr;
+  ZipArchiveP compressed = ZipArchive::compress(name, *input);
+  input.reset();
+  if (!compressed || compressed->size() != 1) return false;
+  // the name could be encoded differently by wxZipOutputStream, so don't look it up
+  String original_name = name;
+  if (!compressed->rawData(compressed->getEntries().begin()->first, *this)) return false;
+  name = original_name;
+  return true;
+}
+
+// ----------------------------------------------------------------------------- : ZipWriter
+
+/// Encode a file name for the archive, and set the matching flags
+/** Names are stored as UTF-8, which for plain ascii names is the same as the old encoding */
+wxCharBuffer encode_zip_name(const String& name, UInt& flags) {
+  wxCharBuffer utf8 = name.utf8_str();
+  flags &= ~(ZIP_FLAG_UTF8 | ZIP_FLAG_DATA_DESCRIPTOR); // the sizes are always in the local header
+  for (const char* c = utf8.data() ; *c ; ++c) {
+    if ((unsigned char)*c >= 0x80) {
+      flags |= ZIP_FLAG_UTF8;
+      break;
+    }
+  }
+  return utf8;
+}
+
+ZipWriter::ZipWriter(wxOutputStream& out, size_t offset)
+  : out(out), offset(offset), ok(true), count(0)
+{}
+
+void ZipWriter::write(const ZipData& file) {
+  const ZipArchive::Entry& entry = file.info;
+  if (!ok || !file.data || entry.compressed_size > ZIP_MAX_SIZE || entry.size > ZIP_MAX_SIZE || offset > ZIP_MAX_SIZE) {
+    ok = false;
+    return;
+  }
+  UInt flags = entry.flags;
+  wxCharBuffer name = encode_zip_name(file.name, flags);
+  size_t name_size = strlen(name.data());
+  vector<Byte> header;
+  write_u32(header, ZIP_LOCAL_HEADER_SIG);
+  write_u16(header, ZIP_VERSION);
+  write_u16(header, flags);
+  write_u16(header, entry.method);
+  write_u32(header, entry.dos_time);
+  write_u32(header, entry.crc);
+  write_u32(header, (UInt)entry.compressed_size);
+  write_u32(header, (UInt)entry.size);
+  write_u16(header, (UInt)name_size);
+  write_u16(header, 0); // no extra field
+  header.insert(header.end(), name.data(), name.data() + name_size);
+  addCentral(file.name, entry, offset, false); // the sizes are in the local header
+  out.Write(header.data(), header.size());
+  out.Write(file.data, entry.compressed_size);
+  offset += header.size() + entry.compressed_size;
+  if (!out.IsOk()) ok = false;
+}
+
+void ZipWriter::addExisting(const String& name, const ZipArchive::Entry& entry) {
+  // the local header is not rewritten, so the flag must stay as it was
+  addCentral(name, entry, entry.header_offset, entry.flags & ZIP_FLAG_DATA_DESCRIPTOR);
+}
+
+void ZipWriter::addCentral(const String& name_str, const ZipArchive::Entry& entry, size_t header_offset, bool data_descriptor) {
+  if (++count > ZIP_MAX_COUNT || header_offset > ZIP_MAX_SIZE) ok = false;
+  if (!ok) return;
+  UInt flags = entry.flags;
+  wxCharBuffer name = encode_zip_name(name_str, flags);
+  if (data_descriptor) flags |= ZIP_FLAG_DATA_DESCRIPTOR;
+  size_t name_size = strlen(name.data());
+  write_u32(directory, ZIP_CENTRAL_HEADER_SIG);
+  write_u16(directory, ZIP_VERSION); // made by, MS-DOS attributes
+  write_u16(directory, ZIP_VERSION); // needed to extract
+  write_u16(directory, flags);
+  write_u16(directory, entry.method);
+  write_u32(directory, entry.dos_time);
+  write_u32(directory, entry.crc);
+  write_u32(directory, (UInt)entry.compressed_size);
+  write_u32(directory, (UInt)entry.size);
+  write_u16(directory, (UInt)name_size);
+  write_u16(directory, 0); // no extra field
+  write_u16(directory, 0); // no comment
+  write_u16(directory, 0); // disk number
+  write_u16(directory, 0); // internal attributes
+  write_u32(directory, 0); // external attributes
+  write_u32(directory, (UInt)header_offset);
+  directory.insert(directory.end(), name.data(), name.data() + name_size);
+}
+
+bool ZipWriter::close() {
+  size_t cd_offset = offset;
+  if (!ok || cd_offset > ZIP_MAX_SIZE || directory.size() > ZIP_MAX_SIZE - cd_offset) return false;
+  vector<Byte> end;
+  write_u32(end, ZIP_END_RECORD_SIG);
+  write_u16(end, 0); // disk number
+  write_u16(end, 0); // disk with the central directory
+  write_u16(end, count);
+  write_u16(end, count);
+  write_u32(end, (UInt)directory.size());
+  write_u32(end, (UInt)cd_offset);
+  write_u16(end, 0); // no comment
+  out.Write(directory.data(), directory.size());
+  out.Write(end.data(), end.size());
+  offset += directory.size() + end.size();
+  return out.IsOk();
+}
@@ -0,0 +1,139 @@
+//+----------------------------------------------------------------------------+
+//| Description:  Magic Set Editor - Program to make Magic (tm) cards          |
+//| Copyright:    (C) Twan van Laarhoven and the other MSE developers          |
+//| License:      GNU General Public License 2 or later (see file COPYING)     |
+//+----------------------------------------------------------------------------+
+
+#pragma once
+
+// ----------------------------------------------------------------------------- : Includes
+
+#include <util/prec.hpp>
+
+DECLARE_POINTER_TYPE(ZipArchive);
+struct ZipData;
+
+// ----------------------------------------------------------------------------- : ZipArchive
+
+/// A zip file that is mapped into memory, with an index of its central directory
+/** Opening a file in the archive doesn't touch the disk:
+ *   - stored files are read directly from the mapped memory,
+ *   - deflated files are read through a decompressing stream over the mapped memory.
+ *  Streams keep the archive alive, so they can outlive the Package that opened them.
+ *
+ *  Only plain zip files are supported: no zip64, no encryption, no multi disk archives.
+ *  For other files open() returns nullptr, and wxZipInputStream should be used instead.
+ *
+ *  If the end of the file is damaged (e.g. an append was interrupted),
+ *  the last intact central directory is used. The file itself is never changed.
+ */
+class ZipArchive : public IntrusivePtrBase<ZipArchive> {
+public:
+  ~ZipArchive();
+
+  /// Map and index a zip file, returns nullptr if this is not possible
+  static ZipArchiveP open(const String& filename);
+  /// Compress data into a new archive in memory containing a single file, returns nullptr on failure
+  static ZipArchiveP compress(const String& name, wxInputStream& in);
+
+  /// A file in the archive
+  struct Entry {
+    UInt   method;           ///< Compression method, see zip_archive.cpp
+    UInt   flags;            ///< General purpose flags from the central directory
+    UInt   crc;              ///< CRC32 of the uncompressed data
+    UInt   dos_time;         ///< Modification time in MS-DOS format (date << 16 | time)
+    size_t compressed_size;
+    size_t size;             ///< Uncompressed size
+    size_t header_offset;    ///< Offset of the local file header
+    size_t stored_size;      ///< Space taken up in the file, including the local header
+  };
+  typedef unordered_map<String,Entry> Entries;
+
+  /// All files in the archive, by (normalized) name
+  inline const Entries& getEntries() const { return entries; }
+
+  /// Find a file by its (normalized) name, returns nullptr if it is not in the archive
+  const Entry* find(const String& name) const;
+
+  /// Open a file in the archive for reading
+  /** Returns nullptr if the file is not in the archive, or if it can't be read directly (e.g. encrypted)
+   */
+  unique_ptr<wxInputStream> openIn(const String& name);
+
+  /// Get the compressed data of a file, so it can be copied to another archive without decompressing it
+  /** Returns false if the file is not in the archive */
+  bool rawData(const String& name, ZipData& out);
+
+  /// Number of files in the archive
+  inline size_t size() const { return entries.size(); }
+  /// Size of the archive file
+  size_t fileSize() const;
+  /// Size of the intact archive, smaller than fileSize() if there is junk from an interrupted append after it
+  inline size_t intactSize() const { return intact_size; }
+
+  /// Truncate a file to the given size, returns false on failure
+  static bool truncateFile(const String& filename, size_t size);
+
+private:
+  ZipArchive();
+
+  class MappedFile;
+  unique_ptr<MappedFile> file;
+  Entries entries;
+  size_t intact_size = 0;
+
+  bool readCentralDirectory();
+  /// Read the central directory of the end record at the given position
+  bool readCentralDirectory(size_t end);
+  /// Do all entries have a valid local header, before the central directory at the given offset?
+  bool checkLocalHeaders(size_t cd_offset) const;
+  /// The data of an entry in the mapped file, or nullptr if the local header is invalid
+  const Byte* entryData(const Entry& entry) const;
+};
+
+// ----------------------------------------------------------------------------- : ZipData
+
+/// A compressed file, that can be written to an archive with ZipWriter
+struct ZipData {
+  String                    name;           ///< Name of the file in the archive
+  ZipArchive::Entry         info;           ///< Compression method, sizes, etc., header_offset is not used
+  const Byte*               data = nullptr; ///< The compressed data
+  ZipArchiveP               archive;        ///< Archive that contains the data, keeps it alive
+  unique_ptr<wxInputStream> input;          ///< Data that still has to be compressed
+
+  /// Compress the input of all files that have one, using multiple threads
+  /** Returns false if compressing one of the files failed */
+  static bool compressAll(vector<ZipData>& files);
+  /// Compress the input, on the current thread
+  bool compress();
+};
+
+// ----------------------------------------------------------------------------- : ZipWriter
+
+/// Writes a zip archive from files that are already compressed
+/** Files that are already in the output file can be added to the central directory without writing them again,
+ *  this is used for appending to an existing archive.
+ *  Like ZipArchive only plain zip files are written, archives that would need zip64 fail.
+ */
+class ZipWriter {
+public:
+  /// Write to a stream, that starts at the given offset in the file
+  ZipWriter(wxOutputStream& out, size_t offset = 0);
+
+  /// Write a file to the archive
+  void write(const ZipData& file);
+  /// Add a file that is already in the output at entry.header_offset
+  void addExisting(const String& name, const ZipArchive::Entry& entry);
+  /// Finish the archive by writing the central directory, returns false if anything failed
+  bool close();
+
+private:
+  wxOutputStream& out;
+  size_t offset;          ///< Current offset in the file
+  bool   ok;
+  UInt   count;           ///< Number of files in the central directory
+  vector<Byte> directory; ///< Central directory records of the files so far
+
+  /// Add a file to the central directory, data_descriptor indicates that its local header is followed by a data descriptor
+  void addCentral(const String& name, const ZipArchive::Entry& entry, size_t header_offset, bool data_descriptor);
+};
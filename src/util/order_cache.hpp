@@ -13,42 +13,59 @@
 // ----------------------------------------------------------------------------- : OrderCache
 
 /// Object that cashes an ordered version of a list of items, for finding the position of objects
-/** Can be used as a map "void* -> int" for finding the position of an object */
+/** Can be used as a map "void* -> int" for finding the position of an object.
+ *
+ *  The cache can be kept up to date when the values of some items change:
+ *  invalidate() them, and call updateInvalidated() before the cache is used again.
+ *  Only the invalidated items are moved, the others keep their place.
+ */
 template <typename T>
 class OrderCache : public IntrusivePtrBase<OrderCache<T>> {
 public:
   /// Initialize the order cache, ordering the keys by their string values from the other vector
   /** Optionally filter the list using a vector of booleans of items to keep (note: vector<bool> is evil)
+   *  Items with the same value are kept in the order of the keys.
    *  @pre keys.size() == values.size()
    */
   OrderCache(const vector<T>& keys, const vector<String>& values, vector<int>* keep = nullptr);
   
   /// Find the position of the given key in the cache, returns -1 if not found
   int find(const T& key) const;
+  /// Number of items that are kept
+  inline int size() const { return (int)order.size(); }
+  /// Number of keys the cache was initialized with, including the ones that are not kept
+  inline size_t keyCount() const { return items.size(); }
+  
+  /// Mark the value of a key as out of date
+  void invalidate(const T& key);
+  /// Determine the new values of the invalidated keys, using update(key, value, keep)
+  template <typename F> void updateInvalidated(F update);
   
 private:
-  struct CompareKeys;
-  struct CompareValues;
-  typedef pair<void*,int> KV;
-  vector<KV> positions;
+  struct Item {
+    String value;
+    int    index;  ///< Index in the list of keys, orders items with the same value
+    bool   keep;
+    bool   invalid;
+  };
+  typedef typename unordered_map<void*,Item>::value_type* ItemP;
+  struct CompareItems;
+  unordered_map<void*,Item> items;
+  vector<ItemP>             order;   ///< The items that are kept, in order
+  vector<T>                 invalid; ///< Keys marked by invalidate()
+  
+  /// Change the value of an item, and move it to its new position
+  void set(ItemP item, const String& value, bool keep);
 };
 
 // ----------------------------------------------------------------------------- : Implementation
 
 template <typename T>
-struct OrderCache<T>::CompareKeys {
-  inline bool operator () (const KV& a, void*     b) { return a.first < b; }
-  inline bool operator () (const KV& a, const KV& b) { return a.first < b.first; }
-  inline bool operator () (void*     a, const KV& b) { return a       < b.first; }
-};
-
-template <typename T>
-struct OrderCache<T>::CompareValues {
-  const vector<String>& values;
-  CompareValues(const vector<String>& values) : values(values) {}
-  
-  inline bool operator () (const KV& a, const KV& b) {
-    return smart_less(values[a.second], values[b.second]);
+struct OrderCache<T>::CompareItems {
+  inline bool operator () (ItemP a, ItemP b) const {
+    if (smart_less(a->second.value, b->second.value)) return true;
+    if (smart_less(b->second.value, a->second.value)) return false;
+    return a->second.index < b->second.index;
   }
 };
 
@@ -56,29 +73,56 @@ template <typename T>
 OrderCache<T>::OrderCache(const vector<T>& keys, const vector<String>& values, vector<int>* keep) {
   assert(keys.size() == values.size());
   assert(!keep || keep->size() == keys.size());
-  // initialize positions, use pos to point back to the values vector
-  positions.reserve(keys.size());
-  int i = 0;
-  for (typename vector<T>::const_iterator it = keys.begin() ; it != keys.end() ; ++it, ++i) {
-    if (!keep || (*keep)[i]) {
-      positions.push_back(KV(&**it, i));
-    }
-  }
-  // sort the KVs by the values
-  sort(positions.begin(), positions.end(), CompareValues(values));
-  // update positions, to point to sorted list
-  i = 0;
-  for (typename vector<KV>::iterator it = positions.begin() ; it != positions.end() ; ++it, ++i) {
-    it->second = i;
+  items.reserve(keys.size());
+  order.reserve(keys.size());
+  for (size_t i = 0 ; i < keys.size() ; ++i) {
+    Item item = {values[i], (int)i, !keep || (*keep)[i], false};
+    auto it = items.insert(make_pair((void*)&*keys[i], item)).first;
+    if (item.keep) order.push_back(&*it);
   }
-  // sort the KVs by the keys
-  sort(positions.begin(), positions.end(), CompareKeys());
+  sort(order.begin(), order.end(), CompareItems());
 }
 
 template <typename T>
 int OrderCache<T>::find(const T& key) const {
-  vector<KV>::const_iterator it = lower_bound(positions.begin(), positions.end(), &*key, CompareKeys());
-  if (it == positions.end() || it->first != &*key) return -1;
-  return it->second;
+  auto it = items.find((void*)&*key);
+  if (it == items.end() || !it->second.keep) return -1;
+  ItemP item = const_cast<ItemP>(&*it);
+  return (int)(lower_bound(order.begin(), order.end(), item, CompareItems()) - order.begin());
 }
 
+template <typename T>
+void OrderCache<T>::invalidate(const T& key) {
+  auto it = items.find((void*)&*key);
+  if (it == items.end() || it->second.invalid) return;
+  it->second.invalid = true;
+  invalid.push_back(key);
+}
+
+template <typename T> template <typename F>
+void OrderCache<T>::updateInvalidated(F update) {
+  while (!invalid.empty()) {
+    const T& key = invalid.back();
+    String value;
+    bool keep = true;
+    update(key, value, keep); // if this throws, the key stays invalid
+    auto it = items.find((void*)&*key);
+    it->second.invalid = false;
+    set(&*it, value, keep);
+    invalid.pop_back();
+  }
+}
+
+template <typename T>
+void OrderCache<T>::set(ItemP item, const String& value, bool keep) {
+  Item& i = item->second;
+  if (i.keep == keep && i.value == value) return;
+  if (i.keep) {
+    order.erase(lower_bound(order.begin(), order.end(), item, CompareItems()));
+  }
+  i.value = value;
+  i.keep  = keep;
+  if (i.keep) {
+    order.insert(lower_bound(order.begin(), order.end(), item, CompareItems()), item);
+  }
+}
@@ -10,6 +10,7 @@
 #include <util/rotation.hpp>
 #include <gfx/gfx.hpp>
 #include <data/font.hpp>
+#include <wx/thread.h>
 
 // ----------------------------------------------------------------------------- : Rotation
 
@@ -365,6 +366,95 @@ double RotatedDC::GetCharHeight() const {
   }
 }
 
+// ----------------------------------------------------------------------------- : Glyph metrics
+
+/// Maximum number of fonts for which the glyph metrics are remembered
+const size_t MAX_GLYPH_METRICS_FONTS = 256;
+
+/// Maximum number of lines for which the character widths are remembered, for each font
+const size_t MAX_GLYPH_METRICS_LINES = 4096;
+
+/// Measured widths of lines of text in one font, in device units
+struct GlyphMetrics {
+  int height; ///< Height of a line of text
+  unordered_map<String,vector<int>> lines; ///< Widths of the characters of lines
+};
+
+/// Glyph metrics by font description and device resolution, can be used from multiple threads
+/** The lock is only held to look up and store metrics, not while measuring text. */
+class GlyphMetricsCache {
+public:
+  void measure(wxDC& dc, const String& text, size_t start, size_t end, vector<int>& widths, int& height) {
+    String key = dc.GetFont().GetNativeFontInfoDesc() << _("@") << dc.GetPPI().y;
+    String line = text.substr(start, end - start);
+    bool known_font = false;
+    {
+      wxMutexLocker locker(lock);
+      auto font = fonts.find(key);
+      if (font != fonts.end()) {
+        known_font = true;
+        height = font->second.height;
+        auto it = font->second.lines.find(line);
+        if (it != font->second.lines.end()) {
+          widths = it->second;
+          return;
+        }
+      }
+    }
+    // measure
+    if (!known_font) {
+      dc.GetTextExtent(_("H"), nullptr, &height);
+      #ifdef __WXGTK__
+        // See HACK in RotatedDC::GetTextExtent
+        int charHeight = dc.GetCharHeight();
+        if (charHeight != height)
+          height += height - charHeight;
+      #endif
+    }
+    // the widths of the characters are the differences between the extents of the prefixes of the line,
+    // these include kerning, ligatures and rounding exactly as the whole line is drawn
+    widths.clear();
+    if (!line.empty()) {
+      wxArrayInt extents;
+      dc.GetPartialTextExtents(line, extents);
+      int prev = 0;
+      for (size_t i = 0 ; i < line.size() ; ++i) {
+        int extent = i < extents.size() ? extents[i] : prev;
+        widths.push_back(extent - prev);
+        prev = extent;
+      }
+    }
+    // store
+    wxMutexLocker locker(lock);
+    if (fonts.size() >= MAX_GLYPH_METRICS_FONTS && fonts.find(key) == fonts.end()) {
+      fonts.clear();
+    }
+    GlyphMetrics& metrics = fonts[key];
+    metrics.height = height;
+    if (metrics.lines.size() >= MAX_GLYPH_METRICS_LINES) metrics.lines.clear();
+    metrics.lines[line] = widths;
+  }
+
+private:
+  wxMutex lock;
+  unordered_map<String,GlyphMetrics> fonts;
+};
+
+GlyphMetricsCache glyph_metrics_cache;
+
+void RotatedDC::GetCharWidths(const String& text, size_t start, size_t end, vector<double>& widths, double& height) const {
+  vector<int> ws;
+  int h;
+  glyph_metrics_cache.measure(dc, text, start, end, ws, h);
+  double scale_x = quality == QUALITY_LOW ? zoomX : zoomX * text_scaling;
+  double scale_y = quality == QUALITY_LOW ? zoomY : zoomY * text_scaling;
+  widths.clear();
+  FOR_EACH(w, ws) {
+    widths.push_back(w / scale_x);
+  }
+  height = h / scale_y;
+}
+
 void RotatedDC::SetClippingRegion(const RealRect& rect) {
   dc.SetDeviceClippingRegion(trRectToRegion(rect));
 }
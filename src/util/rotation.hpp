@@ -200,6 +200,12 @@ public:
   
   RealSize GetTextExtent(const String& text) const;
   double GetCharHeight() const;
+  /// Get the widths of the characters text[start...end) when drawn on a single line, and the height of that line
+  /** The widths are the differences between the extents of the prefixes of the text, as it is drawn.
+   *  The widths of lines are remembered for each font,
+   *  so this is much faster than using GetTextExtent for each prefix of the text.
+   */
+  void GetCharWidths(const String& text, size_t start, size_t end, vector<double>& widths, double& height) const;
   
   void SetClippingRegion(const RealRect& rect);
   void DestroyClippingRegion();
@@ -0,0 +1,28 @@
+# Check that compiled scripts are not reused from the script cache after a file they include has changed
+# Usage: cmake -DMSE=<magicseteditor> -DTEST_DIR=<this directory> -DWORK_DIR=<scratch directory> -P run.cmake
+
+file(REMOVE_RECURSE "${WORK_DIR}")
+set(ENV{HOME} "${WORK_DIR}/home")
+set(data "${WORK_DIR}/home/.magicseteditor/data")
+file(MAKE_DIRECTORY "${data}")
+file(COPY "${TEST_DIR}/data/" DESTINATION "${data}")
+file(COPY "${TEST_DIR}/test.mse-set" DESTINATION "${WORK_DIR}")
+file(WRITE "${WORK_DIR}/input" "cache_test_value\n:quit\n")
+
+function(check_value value)
+  file(WRITE "${data}/test-script-cache.mse-include/script" "cache_test_value := \"${value}\"\n")
+  execute_process(
+    COMMAND "${MSE}" --cli --quiet "${WORK_DIR}/test.mse-set"
+    INPUT_FILE "${WORK_DIR}/input"
+    OUTPUT_VARIABLE output
+    ERROR_VARIABLE output
+    RESULT_VARIABLE result
+  )
+  if (NOT result EQUAL 0 OR NOT output MATCHES "\"${value}\"")
+    message(FATAL_ERROR "Expected \"${value}\", got (exit code ${result}):\n${output}")
+  endif()
+endfunction()
+
+# the first run fills the cache, the second one should see the changed include file
+check_value("first")
+check_value("second")
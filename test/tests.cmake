@@ -16,5 +16,12 @@ add_test(
   COMMAND magicseteditor ${test_dir}/script/script-functions.mse-script
 )
 
+# Script cache tests
+add_test(
+  NAME script-cache-include
+  COMMAND ${CMAKE_COMMAND} -DMSE=$<TARGET_FILE:magicseteditor> -DTEST_DIR=${test_dir}/script-cache
+          -DWORK_DIR=${CMAKE_CURRENT_BINARY_DIR}/script-cache-test -P ${test_dir}/script-cache/run.cmake
+)
+
 # Rendering tests
 # TODO